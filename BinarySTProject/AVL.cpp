@@ -1,9 +1,21 @@
 #include "AVL.h"
+#include "ParallelSort.h"
+#include "WorkStealingPool.h"
 #include <algorithm>
+#include <cstdlib>
 
+// Set operation steps on fewer nodes than this run sequentially
+static const int parallelGrain = 4096;
+
+// Heights are cached in the node, so this is O(1) instead of a subtree walk.
 int AVL::height(BSTNode* n) {
-    if (!n) return 0;
-    return 1 + std::max(height(n->left), height(n->right));
+    return n ? n->height : 0;
+}
+
+// Recomputes the cached height and subtree size of n from its children.
+void AVL::refresh(BSTNode* n) {
+    n->height = 1 + std::max(height(n->left), height(n->right));
+    updateSize(n);
 }
 
 int AVL::balanceFactor(BSTNode* n) {
@@ -28,6 +40,12 @@ BSTNode* AVL::rightRotate(BSTNode* y) {
     else
         x->parent->right = x;
 
+    // y is now below x, so refresh it first
+    refresh(y);
+    refresh(x);
+    TREE_STAT(rotations);
+    changes.record(TreeChange::Rotated, y->key, x->key);
+
     return x;
 }
 
@@ -49,10 +67,16 @@ BSTNode* AVL::leftRotate(BSTNode* x) {
     else
         y->parent->right = y;
 
+    refresh(x);
+    refresh(y);
+    TREE_STAT(rotations);
+    changes.record(TreeChange::Rotated, x->key, y->key);
+
     return y;
 }
 
 BSTNode* AVL::rebalance(BSTNode* node) {
+    refresh(node);
     int bf = balanceFactor(node);
     if (bf > 1) {
         if (balanceFactor(node->left) >= 0)
@@ -73,32 +97,43 @@ BSTNode* AVL::rebalance(BSTNode* node) {
     return node;
 }
 
-BSTNode* AVL::insertRec(BSTNode* node, int k, int v, BSTNode* parent) {
+BSTNode* AVL::insertRec(BSTNode* node, int k, int v, BSTNode* parent, InsertResult& result) {
     if (!node) {
-        BSTNode* n = new BSTNode(k, v);
+        BSTNode* n = pool.create(k, v);
+        TREE_STAT(allocations);
         n->parent = parent;
+        result = InsertResult(true, n, 0);
+        changes.record(TreeChange::Created, k);
         return n;
     }
+    TREE_STAT(visited);
+    TREE_STAT(comparisons);
+    if (k == node->key) {
+        result = InsertResult(false, node, 0);  // Reject duplicate
+        return node;
+    }
     if (k < node->key)
-        node->left = insertRec(node->left, k, v, node);
+        node->left = insertRec(node->left, k, v, node, result);
     else
-        node->right = insertRec(node->right, k, v, node);
-    return rebalance(node);
+        node->right = insertRec(node->right, k, v, node, result);
+    // Nothing below changed for a duplicate, so skip the retrace
+    return result.inserted ? rebalance(node) : node;
 }
 
-void AVL::insert(int k, int v) {
-
-    SearchResult existing = search(k);
-    if (existing.found) {
-        return;  // Reject duplicate
-    }
-
-    root = insertRec(root, k, v, nullptr);
+// Duplicate detection happens during the same descent, no prior search.
+BST::InsertResult AVL::tryInsert(int k, int v) {
+    InsertResult result;
+    root = insertRec(root, k, v, nullptr, result);
     if (root) root->parent = nullptr;
+    // Rotations on the way up may have moved the node
+    result.depth = depthOf(result.node);
+    return result;
 }
 
 std::pair<BSTNode*, bool> AVL::removeRec(BSTNode* node, int k) {
     if (!node) return {nullptr, false};
+    TREE_STAT(visited);
+    TREE_STAT(comparisons);
     bool removed = false;
     if (k < node->key) {
         auto res = removeRec(node->left, k);
@@ -117,12 +152,12 @@ std::pair<BSTNode*, bool> AVL::removeRec(BSTNode* node, int k) {
         if (!node->left || !node->right) {
             BSTNode* tmp = node->left ? node->left : node->right;
             if (!tmp) {
-                delete node;
+                pool.destroy(node);
                 return {nullptr, true};
             }
             else {
                 tmp->parent = node->parent;
-                delete node;
+                pool.destroy(node);
                 return {tmp, true};
             }
         }
@@ -147,5 +182,289 @@ bool AVL::remove(int k) {
     auto res = removeRec(root, k);
     root = res.first;
     if (root) root->parent = nullptr;
+    if (res.second) changes.record(TreeChange::Removed, k);
     return res.second;
+}
+
+// Links l, k and r (keys in that order) into one subtree and returns its
+// root. When the heights differ by more than one, k replaces the first node
+// down the taller side's inner spine that is at most one taller than the
+// other side, and the path above is rebalanced like after an insert, so the
+// cost is O(|height(l) - height(r)| + 1). Rotations at the top point root at
+// the result; callers set root once all pieces are joined.
+BSTNode* AVL::joinNodes(BSTNode* l, BSTNode* k, BSTNode* r) {
+    k->parent = nullptr;
+    if (std::abs(height(l) - height(r)) <= 1) {
+        k->left = l;
+        k->right = r;
+        if (l) l->parent = k;
+        if (r) r->parent = k;
+        refresh(k);
+        return k;
+    }
+
+    bool intoLeft = height(l) > height(r);
+    BSTNode* top = intoLeft ? l : r;
+    int limit = height(intoLeft ? r : l) + 1;
+    BSTNode* p = nullptr;
+    BSTNode* c = top;
+    while (height(c) > limit) {
+        TREE_STAT(visited);
+        p = c;
+        c = intoLeft ? c->right : c->left;
+    }
+    if (intoLeft) {
+        k->left = c;
+        k->right = r;
+        p->right = k;
+    }
+    else {
+        k->left = l;
+        k->right = c;
+        p->left = k;
+    }
+    k->parent = p;
+    if (k->left) k->left->parent = k;
+    if (k->right) k->right->parent = k;
+    refresh(k);
+
+    root = top;
+    for (BSTNode* n = p; n; ) {
+        BSTNode* up = n->parent;
+        rebalance(n);
+        n = up;
+    }
+    return root;
+}
+
+// Concatenates l and r, every key of l being below every key of r, by
+// splitting off l's largest node to join them with.
+BSTNode* AVL::join2(BSTNode* l, BSTNode* r) {
+    if (!l) return r;
+    if (!r) return l;
+    BSTNode* rest, * none;
+    BSTNode* last = splitNodes(l, maximum(l)->key, rest, none);
+    return joinNodes(rest, last, r);
+}
+
+// Splits the subtree t around k into the keys below k (l) and above it (r),
+// and returns k's node, detached, or nullptr if k is absent. Each level
+// joins the part it keeps onto what the level below returned; the height
+// differences of those joins telescope, so the whole split is O(log n).
+BSTNode* AVL::splitNodes(BSTNode* t, int k, BSTNode*& l, BSTNode*& r) {
+    if (!t) {
+        l = r = nullptr;
+        return nullptr;
+    }
+    TREE_STAT(visited);
+    TREE_STAT(comparisons);
+    BSTNode* below = t->left;
+    BSTNode* above = t->right;
+    if (below) below->parent = nullptr;
+    if (above) above->parent = nullptr;
+    t->left = t->right = t->parent = nullptr;
+
+    if (k == t->key) {
+        l = below;
+        r = above;
+        refresh(t);
+        return t;
+    }
+    BSTNode* found;
+    BSTNode* mid;
+    if (k < t->key) {
+        found = splitNodes(below, k, l, mid);
+        r = joinNodes(mid, t, above);
+    }
+    else {
+        found = splitNodes(above, k, mid, r);
+        l = joinNodes(below, t, mid);
+    }
+    return found;
+}
+
+// Moves the keys below k into left and those above it into right, replacing
+// what they held; k itself is dropped. Either side may be this tree, which is
+// otherwise left empty. Returns whether k was present.
+bool AVL::split(int k, AVL& left, AVL& right) {
+    BSTNode* l, * r;
+    BSTNode* found = splitNodes(root, k, l, r);
+    root = nullptr;
+    if (found) pool.destroy(found);
+
+    // One side takes over this pool (the larger one, unless this tree is
+    // one of them), the other shares its slabs
+    AVL& keeper = &right == this || (&left != this && sizeOf(r) > sizeOf(l)) ? right : left;
+    AVL& other = &keeper == &left ? right : left;
+    if (&keeper != this) {
+        keeper.clearTree();
+        keeper.pool.swap(pool);
+    }
+    if (&other != this) {
+        other.clearTree();
+        other.pool.share(keeper.pool);
+    }
+    if (&left != this && &right != this) clearTree();
+    left.root = l;
+    right.root = r;
+    for (AVL* t : { &left, &right }) {
+        if (t->root) {
+            t->root->parent = nullptr;
+        }
+        t->changes.reset();
+    }
+    return found != nullptr;
+}
+
+// Replaces this tree with left's keys, k and right's keys, leaving left and
+// right empty (either may be this tree). Fails without changing anything
+// unless every key of left is below k and every key of right above it.
+// O(|height(left) - height(right)| + 1).
+bool AVL::join(AVL& left, int k, AVL& right) {
+    if ((left.root && maximum(left.root)->key >= k) || (right.root && minimum(right.root)->key <= k))
+        return false;
+    BSTNode* l = left.root;
+    BSTNode* r = right.root;
+    // Take over the larger side's pool unless this tree is one of the sides,
+    // and share the slabs of the rest
+    AVL* donor = nullptr;
+    if (&left != this && &right != this) {
+        donor = sizeOf(r) > sizeOf(l) ? &right : &left;
+        clearTree();
+        pool.swap(donor->pool);
+    }
+    for (AVL* t : { &left, &right }) {
+        if (t == this) continue;
+        if (t != donor) pool.share(t->pool);
+        t->clearTree();
+    }
+    BSTNode* n = pool.create(k, k);
+    TREE_STAT(allocations);
+    root = joinNodes(l, n, r);
+    changes.reset();
+    return true;
+}
+
+// Deletes every key in [lo, hi] with two splits and one join: O(log n) plus
+// handing the removed nodes back to the pool. Returns how many there were.
+int AVL::removeRange(int lo, int hi) {
+    if (lo > hi || !root) return 0;
+    BSTNode* below, * rest, * middle, * above;
+    BSTNode* first = splitNodes(root, lo, below, rest);
+    BSTNode* last = splitNodes(rest, hi, middle, above);
+    int removed = sizeOf(middle) + (first ? 1 : 0) + (last ? 1 : 0);
+    clear(middle);
+    if (first) pool.destroy(first);
+    if (last) pool.destroy(last);
+    root = join2(below, above);
+    if (root) root->parent = nullptr;
+    changes.reset();
+    return removed;
+}
+
+// One step of a set operation on the subtrees a (this side) and b (the
+// other side), run on the calling worker's scratch tree from local: b is
+// split around a's root, the halves below and above are combined, in
+// parallel when there is enough work, and joined back with or without that
+// root. Dropped nodes go to this (scratch) tree's pool.
+BSTNode* AVL::combine(BSTNode* a, BSTNode* b, SetOp op, const std::vector<std::unique_ptr<AVL>>& local) {
+    if (!a || !b) {
+        if (op == Union) return a ? a : b;
+        clear(b);
+        if (op == Difference) return a;
+        clear(a);
+        return nullptr;
+    }
+    int work = sizeOf(a) + sizeOf(b);
+    BSTNode* below = a->left;
+    BSTNode* above = a->right;
+    if (below) below->parent = nullptr;
+    if (above) above->parent = nullptr;
+    a->left = a->right = nullptr;
+
+    BSTNode* l, * r;
+    BSTNode* found = splitNodes(b, a->key, l, r);
+    BSTNode* left, * right;
+    if (work > parallelGrain && !local.empty()) {
+        WorkStealingPool& workers = WorkStealingPool::shared();
+        workers.invoke([&] { left = local[workers.slot()]->combine(below, l, op, local); },
+                       [&] { right = local[workers.slot()]->combine(above, r, op, local); });
+    }
+    else {
+        left = combine(below, l, op, local);
+        right = combine(above, r, op, local);
+    }
+
+    bool keep = op == Union || (op == Intersection) == (found != nullptr);
+    if (found) pool.destroy(found);
+    if (keep) return joinNodes(left, a, right);
+    pool.destroy(a);
+    return join2(left, right);
+}
+
+// Divide-and-conquer on split and join: O(m log(n/m + 1)) work for sizes
+// m <= n and O(log^2 n) span. Large inputs run on the shared work-stealing
+// pool, each worker joining on a scratch tree of its own so that rotations,
+// statistics and freed nodes never touch another thread's state; the
+// scratch trees hand their counters and freed nodes back afterwards.
+void AVL::combineWith(AVL& other, SetOp op) {
+    if (&other == this) {
+        if (op == Difference) clearTree();
+        return;
+    }
+    BSTNode* a = root;
+    BSTNode* b = other.root;
+    pool.share(other.pool);
+    pool.reclaim(other.pool);
+    other.clearTree();
+    root = nullptr;
+
+    std::vector<std::unique_ptr<AVL>> local;
+    if (sizeOf(a) + sizeOf(b) <= parallelGrain) {
+        root = combine(a, b, op, local);
+    }
+    else {
+        WorkStealingPool& workers = WorkStealingPool::shared();
+        for (int i = 0; i < workers.size(); ++i) {
+            local.emplace_back(new AVL);
+            local.back()->changes.setEnabled(false);
+        }
+        workers.run([&] { root = local[workers.slot()]->combine(a, b, op, local); });
+        for (const std::unique_ptr<AVL>& t : local) {
+            pool.reclaim(t->pool);
+            stats += t->stats;
+        }
+    }
+    if (root) root->parent = nullptr;
+    changes.reset();
+}
+
+void AVL::unionWith(AVL& other) {
+    combineWith(other, Union);
+}
+
+void AVL::intersectWith(AVL& other) {
+    combineWith(other, Intersection);
+}
+
+void AVL::differenceWith(AVL& other) {
+    combineWith(other, Difference);
+}
+
+// The sorted batch is built into a balanced tree of its own in one pass and
+// unioned in, so a large batch costs one parallel merge instead of an
+// insert per key. keys is left sorted and deduplicated, as it went in.
+int AVL::insertBatch(std::vector<int>& keys) {
+    parallelSortUnique(keys);
+    int before = size();
+    AVL batch;
+    batch.changes.setEnabled(false);
+    batch.buildFromSorted(keys);
+    stats += batch.stats;
+    unionWith(batch);
+    return size() - before;
+}
+
+Snapshot::Kind AVL::snapshotKind() const {
+    return Snapshot::KindAVL;
 }
\ No newline at end of file
@@ -2,22 +2,48 @@
 #define AVL_H
 
 #include "BST.h"
+#include <memory>
 #include <utility>
+#include <vector>
 
 class AVL : public BST {
 public:
     int height(BSTNode* n);
+    void refresh(BSTNode* n);
     int balanceFactor(BSTNode* n);
 
     BSTNode* rightRotate(BSTNode* y);
     BSTNode* leftRotate(BSTNode* x);
     BSTNode* rebalance(BSTNode* node);
 
-    BSTNode* insertRec(BSTNode* node, int k, int v, BSTNode* parent);
-    void insert(int k, int v) override;
+    BSTNode* insertRec(BSTNode* node, int k, int v, BSTNode* parent, InsertResult& result);
+    InsertResult tryInsert(int k, int v) override;
 
     std::pair<BSTNode*, bool> removeRec(BSTNode* node, int k);
     bool remove(int k) override;
+
+    // Join-based editing. Keys move between trees without being copied;
+    // the trees' pools share the slabs involved (see NodePool::share).
+    BSTNode* joinNodes(BSTNode* l, BSTNode* k, BSTNode* r);
+    BSTNode* join2(BSTNode* l, BSTNode* r);
+    BSTNode* splitNodes(BSTNode* t, int k, BSTNode*& l, BSTNode*& r);
+
+    bool split(int k, AVL& left, AVL& right);
+    bool join(AVL& left, int k, AVL& right);
+    int removeRange(int lo, int hi);
+
+    // Set operations with other, which ends up empty: its nodes are moved
+    // into this tree or freed, never copied.
+    enum SetOp { Union, Intersection, Difference };
+    BSTNode* combine(BSTNode* a, BSTNode* b, SetOp op, const std::vector<std::unique_ptr<AVL>>& local);
+    void combineWith(AVL& other, SetOp op);
+    void unionWith(AVL& other);
+    void intersectWith(AVL& other);
+    void differenceWith(AVL& other);
+
+    int insertBatch(std::vector<int>& keys) override;
+
+    Snapshot::Kind snapshotKind() const override;
 };
 
 #endif // AVL_H
\ No newline at end of file
@@ -1,22 +1,30 @@
 #include "BST.h"
+#include "ParallelSort.h"
 #include <fstream>
 #include <algorithm>
+#include <limits>
 
 BSTNode::BSTNode(int k, int v)
-    : key(k), value(v), left(nullptr), right(nullptr), parent(nullptr) {
+    : key(k), value(v), height(1), size(1), left(nullptr), right(nullptr), parent(nullptr) {
 }
 
 BST::BST() : root(nullptr) {}
 
-BST::~BST() {
-    clear(root);
-}
+// Nodes live in the pool, which releases its slabs on destruction.
+BST::~BST() {}
 
+// Returns the subtree rooted at n to the pool. Uses an explicit stack so
+// that degenerate (chain-shaped) trees cannot overflow the call stack.
 void BST::clear(BSTNode* n) {
-    if (!n) return;
-    clear(n->left);
-    clear(n->right);
-    delete n;
+    std::vector<BSTNode*> stack;
+    if (n) stack.push_back(n);
+    while (!stack.empty()) {
+        BSTNode* cur = stack.back();
+        stack.pop_back();
+        if (cur->left) stack.push_back(cur->left);
+        if (cur->right) stack.push_back(cur->right);
+        pool.destroy(cur);
+    }
 }
 
 BST::SearchResult::SearchResult()
@@ -27,10 +35,29 @@ BST::SearchResult::SearchResult(bool f, int d)
     : found(f), depth(d) {
 }
 
+BST::InsertResult::InsertResult()
+    : inserted(false), node(nullptr), depth(-1) {
+}
+
+BST::InsertResult::InsertResult(bool i, BSTNode* n, int d)
+    : inserted(i), node(n), depth(d) {
+}
+
+int BST::depthOf(BSTNode* n) {
+    int depth = 0;
+    while (n && n->parent) {
+        n = n->parent;
+        depth++;
+    }
+    return depth;
+}
+
 BST::SearchResult BST::search(int k) {
     BSTNode* n = root;
     int depth = 0;
     while (n) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
         if (n->key == k) return SearchResult(true, depth);
         n = (k < n->key) ? n->left : n->right;
         depth++;
@@ -38,43 +65,56 @@ BST::SearchResult BST::search(int k) {
     return SearchResult(false, -1);
 }
 
-void BST::insert(int k, int v) {
-
-    SearchResult existing = search(k);
-    if (existing.found) {
-        return;  // Reject duplicate
-    }
-
-    BSTNode* node = new BSTNode(k, v);
-    if (!root) {
-        root = node;
-        return;
-    }
+// Finds the key or its insertion point in one walk down the tree.
+BST::InsertResult BST::tryInsert(int k, int v) {
     BSTNode* cur = root;
     BSTNode* par = nullptr;
+    int depth = 0;
     while (cur) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
+        if (k == cur->key)
+            return InsertResult(false, cur, depth);  // Reject duplicate
         par = cur;
-
-		if (k == cur->key) {
-            delete node; // Clean up allocated node
-            return; // Reject duplicate
-        }
-
         cur = (k < cur->key) ? cur->left : cur->right;
+        depth++;
     }
+
+    BSTNode* node = pool.create(k, v);
+    TREE_STAT(allocations);
     node->parent = par;
-    if (k < par->key)
+    if (!par)
+        root = node;
+    else if (k < par->key)
         par->left = node;
     else
         par->right = node;
+    updateSizesUpward(par);
+    changes.record(TreeChange::Created, k);
+    return InsertResult(true, node, depth);
+}
+
+void BST::insert(int k, int v) {
+    tryInsert(k, v);
 }
 
 bool BST::remove(int k) {
     BSTNode* z = root;
-    while (z && z->key != k)
+    while (z) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
+        if (z->key == k) break;
         z = (k < z->key) ? z->left : z->right;
+    }
     if (!z) return false;
 
+    // Lowest node whose subtree loses a node once z is unlinked
+    BSTNode* changed = z->parent;
+    if (z->left && z->right) {
+        BSTNode* y = minimum(z->right);
+        changed = (y->parent == z) ? y : y->parent;
+    }
+
     if (!z->left)
         transplant(z, z->right);
     else if (!z->right)
@@ -90,7 +130,9 @@ bool BST::remove(int k) {
         y->left = z->left;
         if (y->left) y->left->parent = y;
     }
-    delete z;
+    pool.destroy(z);
+    updateSizesUpward(changed);
+    changes.record(TreeChange::Removed, k);
     return true;
 }
 
@@ -106,16 +148,179 @@ void BST::transplant(BSTNode* u, BSTNode* v) {
 }
 
 BSTNode* BST::minimum(BSTNode* n) {
-    while (n && n->left)
+    while (n && n->left) {
+        TREE_STAT(visited);
         n = n->left;
+    }
+    return n;
+}
+
+BSTNode* BST::maximum(BSTNode* n) {
+    while (n && n->right) {
+        TREE_STAT(visited);
+        n = n->right;
+    }
     return n;
 }
 
+BSTNode* BST::find(int k) {
+    BSTNode* n = root;
+    while (n) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
+        if (n->key == k) break;
+        n = (k < n->key) ? n->left : n->right;
+    }
+    return n;
+}
+
+BSTNode* BST::predecessor(BSTNode* n) {
+    if (n->left) return maximum(n->left);
+    while (n->parent && n == n->parent->left)
+        n = n->parent;
+    return n->parent;
+}
+
+BSTNode* BST::successor(BSTNode* n) {
+    if (n->right) return minimum(n->right);
+    while (n->parent && n == n->parent->right)
+        n = n->parent;
+    return n->parent;
+}
+
+// Changes oldKey to newKey in O(height). If newKey still falls between the
+// node's neighbours the key is rewritten in place and the shape is left
+// untouched; otherwise the node is removed and newKey inserted.
+bool BST::updateKey(int oldKey, int newKey) {
+    BSTNode* n = find(oldKey);
+    if (!n) return false;
+    if (oldKey == newKey) return true;
+    if (find(newKey)) return false;  // keys are unique
+
+    BSTNode* pred = predecessor(n);
+    BSTNode* succ = successor(n);
+    if ((!pred || pred->key < newKey) && (!succ || newKey < succ->key)) {
+        n->key = newKey;
+        changes.record(TreeChange::Rekeyed, oldKey, newKey);
+        return true;
+    }
+
+    int v = n->value;
+    remove(oldKey);
+    insert(newKey, v);
+    return true;
+}
+
+int BST::sizeOf(BSTNode* n) {
+    return n ? n->size : 0;
+}
+
+void BST::updateSize(BSTNode* n) {
+    n->size = 1 + sizeOf(n->left) + sizeOf(n->right);
+}
+
+void BST::updateSizesUpward(BSTNode* n) {
+    for (; n; n = n->parent) {
+        TREE_STAT(visited);
+        updateSize(n);
+    }
+}
+
+int BST::size() {
+    return sizeOf(root);
+}
+
+// Number of keys strictly smaller than k.
+int BST::rank(int k) {
+    int r = 0;
+    BSTNode* n = root;
+    while (n) {
+        if (k <= n->key) {
+            n = n->left;
+        }
+        else {
+            r += 1 + sizeOf(n->left);
+            n = n->right;
+        }
+    }
+    return r;
+}
+
+// The k-th smallest node (1-based), or nullptr if k is out of range.
+BSTNode* BST::select(int k) {
+    BSTNode* n = root;
+    while (n) {
+        int leftSize = sizeOf(n->left);
+        if (k <= leftSize) {
+            n = n->left;
+        }
+        else if (k == leftSize + 1) {
+            return n;
+        }
+        else {
+            k -= leftSize + 1;
+            n = n->right;
+        }
+    }
+    return nullptr;
+}
+
+// Inorder walk restricted to [lo, hi]: subtrees entirely below lo are
+// never entered and the walk stops at the first key above hi, so this is
+// O(height + number of results).
+std::vector<int> BST::rangeKeys(int lo, int hi) {
+    std::vector<int> out;
+    if (lo > hi) return out;
+    out.reserve(rangeCount(lo, hi));
+
+    std::vector<BSTNode*> stack;
+    BSTNode* n = root;
+    while (n || !stack.empty()) {
+        while (n) {
+            if (n->key < lo) {
+                n = n->right;
+            }
+            else {
+                stack.push_back(n);
+                n = n->left;
+            }
+        }
+        if (stack.empty()) break;
+        n = stack.back();
+        stack.pop_back();
+        if (n->key > hi) break;
+        out.push_back(n->key);
+        n = n->right;
+    }
+    return out;
+}
+
+// Number of keys in [lo, hi], from two rank queries.
+int BST::rangeCount(int lo, int hi) {
+    if (lo > hi) return 0;
+    int upTo = (hi == std::numeric_limits<int>::max()) ? size() : rank(hi + 1);
+    return upTo - rank(lo);
+}
+
+// The traversals below walk parent pointers instead of recursing, so they
+// need no stack at all and stay safe on chain-shaped trees. Each one is
+// confined to the subtree rooted at n.
+
 void BST::inorder(BSTNode* n, std::vector<int>& out) {
     if (!n) return;
-    inorder(n->left, out);
-    out.push_back(n->key);
-    inorder(n->right, out);
+    out.reserve(out.size() + n->size);
+    BSTNode* cur = minimum(n);
+    while (cur) {
+        out.push_back(cur->key);
+        if (cur->right) {
+            cur = minimum(cur->right);
+            continue;
+        }
+        // Climb past every ancestor whose right side is already done
+        while (cur != n && cur == cur->parent->right)
+            cur = cur->parent;
+        cur = (cur == n) ? nullptr : cur->parent;
+    }
 }
 
 std::vector<int> BST::inorderKeys() {
@@ -126,9 +331,30 @@ std::vector<int> BST::inorderKeys() {
 
 void BST::preorder(BSTNode* n, std::vector<int>& out) {
     if (!n) return;
-    out.push_back(n->key);
-    preorder(n->left, out);
-    preorder(n->right, out);
+    out.reserve(out.size() + n->size);
+    BSTNode* cur = n;
+    while (cur) {
+        out.push_back(cur->key);
+        if (cur->left) {
+            cur = cur->left;
+        }
+        else if (cur->right) {
+            cur = cur->right;
+        }
+        else {
+            // Climb to the nearest ancestor with an unvisited right subtree
+            BSTNode* next = nullptr;
+            while (cur != n) {
+                BSTNode* p = cur->parent;
+                if (cur == p->left && p->right) {
+                    next = p->right;
+                    break;
+                }
+                cur = p;
+            }
+            cur = next;
+        }
+    }
 }
 
 std::vector<int> BST::preorderKeys() {
@@ -137,11 +363,26 @@ std::vector<int> BST::preorderKeys() {
     return v;
 }
 
+// First node of a postorder walk: the leaf reached by preferring left.
+static BSTNode* firstPostorder(BSTNode* n) {
+    while (n->left || n->right)
+        n = n->left ? n->left : n->right;
+    return n;
+}
+
 void BST::postorder(BSTNode* n, std::vector<int>& out) {
     if (!n) return;
-    postorder(n->left, out);
-    postorder(n->right, out);
-    out.push_back(n->key);
+    out.reserve(out.size() + n->size);
+    BSTNode* cur = firstPostorder(n);
+    while (true) {
+        out.push_back(cur->key);
+        if (cur == n) break;
+        BSTNode* p = cur->parent;
+        if (cur == p->left && p->right)
+            cur = firstPostorder(p->right);
+        else
+            cur = p;
+    }
 }
 
 std::vector<int> BST::postorderKeys() {
@@ -150,9 +391,31 @@ std::vector<int> BST::postorderKeys() {
     return v;
 }
 
+// Preorder parent-pointer walk that tracks the current depth.
 int BST::getHeight(BSTNode* n) {
     if (!n) return 0;
-    return 1 + std::max(getHeight(n->left), getHeight(n->right));
+    int depth = 1, best = 1;
+    BSTNode* cur = n;
+    while (cur) {
+        best = std::max(best, depth);
+        if (cur->left || cur->right) {
+            cur = cur->left ? cur->left : cur->right;
+            depth++;
+            continue;
+        }
+        BSTNode* next = nullptr;
+        while (cur != n) {
+            BSTNode* p = cur->parent;
+            if (cur == p->left && p->right) {
+                next = p->right;
+                break;
+            }
+            cur = p;
+            depth--;
+        }
+        cur = next;
+    }
+    return best;
 }
 
 int BST::getWidth(BSTNode* n) {
@@ -167,35 +430,180 @@ void BST::saveToFile(const std::string& filename) {
 }
 
 void BST::savePre(BSTNode* n, std::ofstream& ofs) {
-    if (!n) {
-        ofs << "# ";
-        return;
+    // Null entries on the stack stand for the '#' sentinels
+    std::vector<BSTNode*> stack;
+    stack.push_back(n);
+    while (!stack.empty()) {
+        BSTNode* cur = stack.back();
+        stack.pop_back();
+        if (!cur) {
+            ofs << "# ";
+            continue;
+        }
+        ofs << cur->key << " ";
+        stack.push_back(cur->right);
+        stack.push_back(cur->left);
     }
-    ofs << n->key << " ";
-    savePre(n->left, ofs);
-    savePre(n->right, ofs);
 }
 
 void BST::loadFromFile(const std::string& filename) {
     std::ifstream ifs(filename);
     if (!ifs.is_open()) return;
-    clear(root);
+    clearTree();
     root = loadPre(ifs, nullptr);
 }
 
+// Reads one preorder subtree and hangs it under parent. Pending child
+// links are kept on an explicit stack, like loadBinary, so arbitrarily
+// deep files load without recursion.
 BSTNode* BST::loadPre(std::ifstream& ifs, BSTNode* parent) {
+    BSTNode* subtree = nullptr;
+    std::vector<BSTNode**> slots;
+    std::vector<BSTNode*> nodes;
+    std::vector<BSTNode*> parents;
+    slots.push_back(&subtree);
+    parents.push_back(parent);
+
     std::string tok;
-    if (!(ifs >> tok)) return nullptr;
-    if (tok == "#") return nullptr;
-    int k = std::stoi(tok);
-    BSTNode* n = new BSTNode(k, k);
-    n->parent = parent;
-    n->left = loadPre(ifs, n);
-    n->right = loadPre(ifs, n);
-    return n;
+    while (!slots.empty() && (ifs >> tok)) {
+        BSTNode** slot = slots.back();
+        BSTNode* par = parents.back();
+        slots.pop_back();
+        parents.pop_back();
+        if (tok == "#") continue;
+
+        int k = std::stoi(tok);
+        BSTNode* n = pool.create(k, k);
+        TREE_STAT(allocations);
+        n->parent = par;
+        *slot = n;
+        nodes.push_back(n);
+        slots.push_back(&n->right);
+        parents.push_back(n);
+        slots.push_back(&n->left);
+        parents.push_back(n);
+    }
+
+    // Preorder puts children after their parent: fill the caches bottom-up
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+        BSTNode* n = *it;
+        n->height = 1 + std::max(n->left ? n->left->height : 0,
+                                 n->right ? n->right->height : 0);
+        updateSize(n);
+    }
+    return subtree;
 }
 
+Snapshot::Kind BST::snapshotKind() const {
+    return Snapshot::KindBST;
+}
+
+void BST::saveBinary(const std::string& filename) {
+    std::vector<char> buf;
+    std::uint64_t count = 0;
+    Snapshot::writeHeader(buf, snapshotKind(), count);
+
+    std::vector<BSTNode*> stack;
+    if (root) stack.push_back(root);
+    while (!stack.empty()) {
+        BSTNode* n = stack.back();
+        stack.pop_back();
+        Snapshot::Record r = { n->key, n->value, 0 };
+        if (n->left) r.flags |= Snapshot::HasLeft;
+        if (n->right) r.flags |= Snapshot::HasRight;
+        Snapshot::appendRecord(buf, r);
+        count++;
+        if (n->right) stack.push_back(n->right);
+        if (n->left) stack.push_back(n->left);
+    }
+
+    Snapshot::writeHeader(buf, snapshotKind(), count);
+    Snapshot::writeFile(filename, buf);
+}
+
+bool BST::loadBinary(const std::string& filename) {
+    std::vector<char> buf;
+    std::uint64_t count = 0;
+    if (!Snapshot::readFile(filename, buf) || !Snapshot::readHeader(buf, snapshotKind(), count))
+        return false;
+    clearTree();
+
+    // Child links still waiting for their subtree, as (parent, isRight).
+    // Records are in preorder, so the top slot is always the next one filled.
+    std::vector<std::pair<BSTNode*, bool>> slots;
+    std::vector<BSTNode*> nodes;
+    nodes.reserve(static_cast<std::size_t>(count));
+    slots.push_back({ nullptr, false });
+    for (std::uint64_t i = 0; i < count && !slots.empty(); ++i) {
+        std::pair<BSTNode*, bool> slot = slots.back();
+        slots.pop_back();
+        Snapshot::Record r = Snapshot::recordAt(buf, i);
+        BSTNode* n = pool.create(r.key, r.value);
+        TREE_STAT(allocations);
+        n->parent = slot.first;
+        if (!slot.first) root = n;
+        else if (slot.second) slot.first->right = n;
+        else slot.first->left = n;
+        if (r.flags & Snapshot::HasRight) slots.push_back({ n, true });
+        if (r.flags & Snapshot::HasLeft) slots.push_back({ n, false });
+        nodes.push_back(n);
+    }
+
+    // Children come after their parent in preorder, so walking backwards
+    // fills in the cached heights and sizes bottom-up.
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+        BSTNode* n = *it;
+        n->height = 1 + std::max(n->left ? n->left->height : 0,
+                                 n->right ? n->right->height : 0);
+        updateSize(n);
+    }
+    return true;
+}
+
+// Bulk reset: every node goes back to the pool in O(1).
 void BST::clearTree() {
-    clear(root);
+    pool.reset();
     root = nullptr;
+    changes.reset();
+}
+
+// Replaces the tree with a perfectly balanced one holding keys, which must
+// be strictly increasing. Linear time, and the result is a valid AVL tree.
+void BST::buildFromSorted(const std::vector<int>& keys) {
+    clearTree();
+    root = buildBalanced(keys, 0, static_cast<int>(keys.size()) - 1, nullptr);
+}
+
+BSTNode* BST::buildBalanced(const std::vector<int>& keys, int lo, int hi, BSTNode* parent) {
+    if (lo > hi) return nullptr;
+    int mid = lo + (hi - lo) / 2;
+    BSTNode* n = pool.create(keys[mid], keys[mid]);
+    TREE_STAT(allocations);
+    n->parent = parent;
+    n->left = buildBalanced(keys, lo, mid - 1, n);
+    n->right = buildBalanced(keys, mid + 1, hi, n);
+    n->height = 1 + std::max(n->left ? n->left->height : 0,
+                             n->right ? n->right->height : 0);
+    updateSize(n);
+    return n;
+}
+
+// Inserts a batch of keys, duplicates allowed, and returns how many were
+// new. An empty tree is built balanced in one pass; otherwise the sorted
+// keys go in median first, so a sorted batch cannot grow a long chain.
+// keys is left sorted and deduplicated, as it went in.
+int BST::insertBatch(std::vector<int>& keys) {
+    parallelSortUnique(keys);
+    int before = size();
+    if (!root) buildFromSorted(keys);
+    else insertMedians(keys, 0, static_cast<int>(keys.size()) - 1);
+    return size() - before;
+}
+
+void BST::insertMedians(const std::vector<int>& keys, int lo, int hi) {
+    if (lo > hi) return;
+    int mid = lo + (hi - lo) / 2;
+    insert(keys[mid], keys[mid]);
+    insertMedians(keys, lo, mid - 1);
+    insertMedians(keys, mid + 1, hi);
 }
\ No newline at end of file
@@ -3,9 +3,15 @@
 
 #include <vector>
 #include <string>
+#include "NodePool.h"
+#include "Snapshot.h"
+#include "TreeChange.h"
+#include "TreeStats.h"
 
 struct BSTNode {
     int key, value;
+    int height;     // cached subtree height, kept up to date by AVL
+    int size;       // number of nodes in this subtree
     BSTNode* left;
     BSTNode* right;
     BSTNode* parent;
@@ -15,6 +21,9 @@ struct BSTNode {
 class BST {
 public:
     BSTNode* root;
+    NodePool<BSTNode> pool;
+    ChangeList changes;
+    TreeStats stats;
 
     BST();
     virtual ~BST();
@@ -29,11 +38,39 @@ public:
     };
 
     SearchResult search(int k);
+
+    // Outcome of a single-walk insert: the new node, or the existing one
+    // when the key was already present, and its depth after rebalancing.
+    struct InsertResult {
+        bool inserted;
+        BSTNode* node;
+        int depth;
+        InsertResult();
+        InsertResult(bool i, BSTNode* n, int d);
+    };
+    virtual InsertResult tryInsert(int k, int v);
     virtual void insert(int k, int v);
+    int depthOf(BSTNode* n);
     virtual bool remove(int k);
 
     void transplant(BSTNode* u, BSTNode* v);
     BSTNode* minimum(BSTNode* n);
+    BSTNode* maximum(BSTNode* n);
+    BSTNode* find(int k);
+    BSTNode* predecessor(BSTNode* n);
+    BSTNode* successor(BSTNode* n);
+    bool updateKey(int oldKey, int newKey);
+
+    static int sizeOf(BSTNode* n);
+    void updateSize(BSTNode* n);
+    void updateSizesUpward(BSTNode* n);
+
+    int size();
+    int rank(int k);
+    BSTNode* select(int k);
+
+    std::vector<int> rangeKeys(int lo, int hi);
+    int rangeCount(int lo, int hi);
 
     void inorder(BSTNode* n, std::vector<int>& out);
     std::vector<int> inorderKeys();
@@ -52,7 +89,17 @@ public:
     void loadFromFile(const std::string& filename);
     BSTNode* loadPre(std::ifstream& ifs, BSTNode* parent);
 
+    virtual Snapshot::Kind snapshotKind() const;
+    void saveBinary(const std::string& filename);
+    bool loadBinary(const std::string& filename);
+
     void clearTree();
+
+    void buildFromSorted(const std::vector<int>& keys);
+    BSTNode* buildBalanced(const std::vector<int>& keys, int lo, int hi, BSTNode* parent);
+
+    virtual int insertBatch(std::vector<int>& keys);
+    void insertMedians(const std::vector<int>& keys, int lo, int hi);
 };
 
 #endif // BST_H
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded multi-producer, single-consumer FIFO (Vyukov's intrusive queue).
+// push() is one atomic exchange and never blocks or waits on the consumer;
+// pop() never takes a lock either. A pop() racing with a push() that has
+// swapped the head but not linked its node yet reports empty, so a consumer
+// that knows an item is coming simply retries.
+template <typename T>
+class CommandQueue {
+public:
+    CommandQueue() : head(&stub), tail(&stub) {
+        stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    ~CommandQueue() {
+        T item;
+        while (pop(item)) {}
+    }
+
+    void push(T item) {
+        Node* n = new Node;
+        n->value = std::move(item);
+        n->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // Consumer thread only
+    bool pop(T& item) {
+        Node* t = tail;
+        Node* next = t->next.load(std::memory_order_acquire);
+        if (t == &stub) {
+            if (!next) return false;
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail = next;
+            item = std::move(t->value);
+            delete t;
+            return true;
+        }
+        if (t != head.load(std::memory_order_acquire)) return false;
+
+        // t is the last node: put the stub behind it so t can be handed out
+        stub.next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head.exchange(&stub, std::memory_order_acq_rel);
+        prev->next.store(&stub, std::memory_order_release);
+        next = t->next.load(std::memory_order_acquire);
+        if (!next) return false;
+        tail = next;
+        item = std::move(t->value);
+        delete t;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    std::atomic<Node*> head;    // producers push here
+    Node* tail;                 // consumer pops here
+    Node stub;
+};
+
+#endif // COMMANDQUEUE_H
\ No newline at end of file
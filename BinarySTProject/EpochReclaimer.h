@@ -0,0 +1,103 @@
+#ifndef EPOCHRECLAIMER_H
+#define EPOCHRECLAIMER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation for one writer and up to MaxReaders readers.
+//
+// A reader announces the global epoch in its slot while it looks at shared
+// data (enter/leave, two stores). The writer unlinks something, retires it
+// with the current epoch, and collect() advances the epoch and runs every
+// retirement older than the oldest announced one: a reader announcing a
+// later epoch started after the unlink and cannot reach it. Readers never
+// wait; the writer never waits for readers either, it just frees later.
+class EpochReclaimer {
+public:
+    static const int MaxReaders = 64;
+
+    EpochReclaimer() : epoch(1) {
+        for (Slot& s : slots) {
+            s.claimed.store(false, std::memory_order_relaxed);
+            s.announced.store(0, std::memory_order_relaxed);
+        }
+    }
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    // Readers must be gone by now
+    ~EpochReclaimer() {
+        for (Retired& r : retired) r.free();
+    }
+
+    // Claims a reader slot; -1 when all are taken
+    int attach() {
+        for (int i = 0; i < MaxReaders; ++i) {
+            bool expected = false;
+            if (!slots[i].claimed.load(std::memory_order_relaxed)
+                && slots[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                return i;
+        }
+        return -1;
+    }
+
+    void detach(int slot) {
+        slots[slot].announced.store(0, std::memory_order_release);
+        slots[slot].claimed.store(false, std::memory_order_release);
+    }
+
+    // Reader side. Sequentially consistent so that either the writer's scan
+    // sees the announcement, or the reader sees what was published before it.
+    void enter(int slot) {
+        slots[slot].announced.store(epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+
+    void leave(int slot) {
+        slots[slot].announced.store(0, std::memory_order_release);
+    }
+
+    // Writer side, after whatever free() touches has been unlinked
+    void retire(std::function<void()> free) {
+        retired.push_back({ epoch.load(std::memory_order_relaxed), std::move(free) });
+    }
+
+    void collect() {
+        if (retired.empty()) return;
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+
+        std::uint64_t oldest = UINT64_MAX;
+        for (const Slot& s : slots) {
+            std::uint64_t e = s.announced.load(std::memory_order_seq_cst);
+            if (e != 0 && e < oldest) oldest = e;
+        }
+
+        // Retirements are in epoch order
+        size_t done = 0;
+        while (done < retired.size() && retired[done].epoch < oldest) {
+            retired[done].free();
+            ++done;
+        }
+        retired.erase(retired.begin(), retired.begin() + done);
+    }
+
+    size_t pending() const { return retired.size(); }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<bool> claimed;
+        std::atomic<std::uint64_t> announced;   // 0 while the reader is outside
+    };
+    struct Retired {
+        std::uint64_t epoch;
+        std::function<void()> free;
+    };
+
+    std::atomic<std::uint64_t> epoch;
+    Slot slots[MaxReaders];
+    std::vector<Retired> retired;   // writer only
+};
+
+#endif // EPOCHRECLAIMER_H
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Slab allocator shared by BST, AVL and RBTree nodes.
+// Nodes are carved out of contiguous slabs (each one twice the size of the
+// previous) and recycled through a free list, so inserts never hit the
+// global heap once the pool is warm and clearing a whole tree is a reset.
+//
+// Trees that hand nodes to each other (split, join) swap or share the slabs
+// those nodes live in, so a slab is only freed once no pool refers to it.
+template <typename Node>
+class NodePool {
+public:
+    NodePool() : slabIndex(0), slabUsed(0) {}
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    Node* create(int k, int v) {
+        Node* n;
+        if (!freeList.empty()) {
+            n = freeList.back();
+            freeList.pop_back();
+        }
+        else {
+            n = next();
+        }
+        *n = Node(k, v);
+        return n;
+    }
+
+    void destroy(Node* n) {
+        freeList.push_back(n);
+    }
+
+    // Drops every node at once. Slabs only this pool refers to are kept and
+    // handed out again; shared ones may still hold another tree's nodes.
+    void reset() {
+        freeList.clear();
+        shared.clear();
+        slabs.erase(std::remove_if(slabs.begin(), slabs.end(),
+                                   [](const Slab& s) { return s.nodes.use_count() > 1; }),
+                    slabs.end());
+        slabIndex = 0;
+        slabUsed = 0;
+    }
+
+    // Keeps other's slabs alive for as long as this pool lives, so nodes
+    // created by other can be moved into this pool's tree.
+    void share(const NodePool& other) {
+        if (&other == this) return;
+        for (const Slab& s : other.slabs) keep(s.nodes);
+        for (const std::shared_ptr<Node>& s : other.shared) keep(s);
+    }
+
+    // Takes over other's free nodes, which must live in slabs this pool
+    // holds too (after share())
+    void reclaim(NodePool& other) {
+        freeList.insert(freeList.end(), other.freeList.begin(), other.freeList.end());
+        other.freeList.clear();
+    }
+
+    // Exchanges everything, nodes in use included, with other.
+    void swap(NodePool& other) {
+        slabs.swap(other.slabs);
+        shared.swap(other.shared);
+        freeList.swap(other.freeList);
+        std::swap(slabIndex, other.slabIndex);
+        std::swap(slabUsed, other.slabUsed);
+    }
+
+private:
+    static const std::size_t firstSlabSize = 256;
+
+    struct Slab {
+        std::shared_ptr<Node> nodes;
+        std::size_t size;
+    };
+
+    void keep(const std::shared_ptr<Node>& s) {
+        for (const Slab& own : slabs)
+            if (own.nodes == s) return;
+        if (std::find(shared.begin(), shared.end(), s) == shared.end())
+            shared.push_back(s);
+    }
+
+    Node* next() {
+        if (slabIndex < slabs.size() && slabUsed == slabs[slabIndex].size) {
+            ++slabIndex;
+            slabUsed = 0;
+        }
+        if (slabIndex == slabs.size()) {
+            std::size_t size = slabs.empty() ? firstSlabSize : slabs.back().size * 2;
+            slabs.push_back({ std::shared_ptr<Node>(new Node[size], std::default_delete<Node[]>()), size });
+        }
+        return slabs[slabIndex].nodes.get() + slabUsed++;
+    }
+
+    std::vector<Slab> slabs;                    // carved in order
+    std::vector<std::shared_ptr<Node>> shared;  // other pools' slabs
+    std::vector<Node*> freeList;
+    std::size_t slabIndex, slabUsed;
+};
+
+#endif // NODEPOOL_H
@@ -0,0 +1,37 @@
+#include "OperationLog.h"
+#include <sstream>
+
+OperationLog::OperationLog(const std::string& filename)
+    : filename(filename), count(0) {
+    count = static_cast<int>(readAll().size());
+    out.open(filename, std::ios::out | std::ios::app);
+}
+
+void OperationLog::append(char op, int key) {
+    if (op == Clear)
+        out << op << '\n';
+    else
+        out << op << ' ' << key << '\n';
+    out.flush();
+    count++;
+}
+
+std::vector<OperationLog::Record> OperationLog::readAll() const {
+    std::vector<Record> records;
+    std::ifstream ifs(filename);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream ls(line);
+        Record r = { 0, 0 };
+        if (!(ls >> r.op)) continue;
+        if (r.op != Clear && !(ls >> r.key)) break;  // torn tail after a crash
+        records.push_back(r);
+    }
+    return records;
+}
+
+void OperationLog::truncate() {
+    out.close();
+    out.open(filename, std::ios::out | std::ios::trunc);
+    count = 0;
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef OPERATIONLOG_H
+#define OPERATIONLOG_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Append-only journal of tree mutations.
+// Each record is one text line ("I 42", "D 7", "C") so a mutation costs a
+// single small write instead of rewriting the whole snapshot file. The
+// owner periodically checkpoints the tree and truncates the journal.
+class OperationLog {
+public:
+    enum Op {
+        Insert = 'I',
+        Delete = 'D',
+        Clear = 'C'
+    };
+
+    struct Record {
+        char op;
+        int key;
+    };
+
+    explicit OperationLog(const std::string& filename);
+
+    void append(char op, int key = 0);
+    std::vector<Record> readAll() const;
+    void truncate();
+
+    int size() const { return count; }
+
+private:
+    std::string filename;
+    std::ofstream out;
+    int count;
+};
+
+#endif // OPERATIONLOG_H
\ No newline at end of file
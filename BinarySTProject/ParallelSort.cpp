@@ -0,0 +1,56 @@
+#include "ParallelSort.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+// Ranges shorter than this are sorted or merged sequentially
+static const std::size_t sortGrain = 1 << 14;
+
+// Merges two sorted ranges into out. The larger range is cut at its middle
+// key and the other one at the same key, and the two halves merge in
+// parallel, which keeps the span polylogarithmic.
+static void merge(const int* a, const int* aEnd, const int* b, const int* bEnd, int* out, WorkStealingPool& workers) {
+    if (aEnd - a < bEnd - b) {
+        std::swap(a, b);
+        std::swap(aEnd, bEnd);
+    }
+    if (static_cast<std::size_t>((aEnd - a) + (bEnd - b)) <= sortGrain) {
+        std::merge(a, aEnd, b, bEnd, out);
+        return;
+    }
+    const int* aMid = a + (aEnd - a) / 2;
+    const int* bMid = std::lower_bound(b, bEnd, *aMid);
+    int* outMid = out + (aMid - a) + (bMid - b);
+    workers.invoke([&] { merge(a, aMid, b, bMid, out, workers); },
+                   [&] { merge(aMid, aEnd, bMid, bEnd, outMid, workers); });
+}
+
+// Sorts the n keys at a, using tmp (same size) as the other buffer. The
+// halves are sorted into the buffer the result is not going to, so each
+// level merges straight across and nothing is copied back.
+static void mergeSort(int* a, int* tmp, std::size_t n, bool intoTmp, WorkStealingPool& workers) {
+    if (n <= sortGrain) {
+        std::sort(a, a + n);
+        if (intoTmp) std::copy(a, a + n, tmp);
+        return;
+    }
+    std::size_t half = n / 2;
+    workers.invoke([&] { mergeSort(a, tmp, half, !intoTmp, workers); },
+                   [&] { mergeSort(a + half, tmp + half, n - half, !intoTmp, workers); });
+    int* from = intoTmp ? a : tmp;
+    int* to = intoTmp ? tmp : a;
+    merge(from, from + half, from + half, from + n, to, workers);
+}
+
+void parallelSortUnique(std::vector<int>& keys) {
+    if (keys.size() <= sortGrain) {
+        std::sort(keys.begin(), keys.end());
+    }
+    else {
+        std::vector<int> tmp(keys.size());
+        WorkStealingPool& workers = WorkStealingPool::shared();
+        workers.run([&] { mergeSort(keys.data(), tmp.data(), keys.size(), false, workers); });
+    }
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#ifndef PARALLELSORT_H
+#define PARALLELSORT_H
+
+#include <vector>
+
+// Sorts keys and drops duplicates. Large inputs are merge sorted on the
+// shared work-stealing pool, merges included; the final duplicate sweep is
+// one sequential pass.
+void parallelSortUnique(std::vector<int>& keys);
+
+#endif // PARALLELSORT_H
\ No newline at end of file
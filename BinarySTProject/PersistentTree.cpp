@@ -0,0 +1,897 @@
+#include "PersistentTree.h"
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+VersionNode::VersionNode(int k, int v)
+    : key(k), value(v), height(1), size(1), red(true), left(nullptr), right(nullptr),
+      parent(nullptr), refs(1), edit(0) {
+}
+
+PersistentTree::PersistentTree() : edit(0), root(nullptr) {}
+
+// Nodes live in the pool, which releases its slabs on destruction.
+PersistentTree::~PersistentTree() {}
+
+void PersistentTree::retain(VersionNode* n) {
+    if (n) ++n->refs;
+}
+
+// Drops one reference to n. Freeing a node drops its references to its
+// children, so whatever only n pointed to goes with it.
+void PersistentTree::release(VersionNode* n) {
+    std::vector<VersionNode*> stack;
+    if (n) stack.push_back(n);
+    while (!stack.empty()) {
+        VersionNode* cur = stack.back();
+        stack.pop_back();
+        if (--cur->refs > 0) continue;
+        if (cur->left) stack.push_back(cur->left);
+        if (cur->right) stack.push_back(cur->right);
+        pool.destroy(cur);
+    }
+}
+
+int PersistentTree::sizeOf(const VersionNode* n) {
+    return n ? n->size : 0;
+}
+
+const VersionNode* PersistentTree::find(const VersionNode* root, int k) {
+    while (root && root->key != k)
+        root = (k < root->key) ? root->left : root->right;
+    return root;
+}
+
+// Keys only in from go to removed and keys only in to go to added, both in
+// key order. Two in-order walks run side by side and skip the subtrees the
+// versions share whole, so versions a few edits apart are compared in time
+// proportional to the paths those edits copied.
+void PersistentTree::diff(const VersionNode* from, const VersionNode* to,
+                          std::vector<int>& removed, std::vector<int>& added) {
+    // An entry is a subtree still to walk, or a node whose left subtree is done
+    struct Entry { const VersionNode* node; bool whole; };
+    auto expand = [](std::vector<Entry>& s) {
+        const VersionNode* n = s.back().node;
+        s.pop_back();
+        if (n->right) s.push_back({ n->right, true });
+        s.push_back({ n, false });
+        if (n->left) s.push_back({ n->left, true });
+    };
+    std::vector<Entry> a, b;
+    if (from) a.push_back({ from, true });
+    if (to) b.push_back({ to, true });
+
+    while (!a.empty() && !b.empty()) {
+        Entry x = a.back();
+        Entry y = b.back();
+        if (x.whole && y.whole && x.node == y.node) {
+            a.pop_back();
+            b.pop_back();
+        }
+        else if (x.whole && (!y.whole || x.node->size >= y.node->size)) {
+            expand(a);  // the larger side, where a shared subtree may hide
+        }
+        else if (y.whole) {
+            expand(b);
+        }
+        else if (x.node->key < y.node->key) {
+            removed.push_back(x.node->key);
+            a.pop_back();
+        }
+        else if (y.node->key < x.node->key) {
+            added.push_back(y.node->key);
+            b.pop_back();
+        }
+        else {
+            a.pop_back();
+            b.pop_back();
+        }
+    }
+    for (std::vector<Entry>* s : { &a, &b }) {
+        std::vector<int>& out = s == &a ? removed : added;
+        while (!s->empty()) {
+            if (s->back().whole) {
+                expand(*s);
+                continue;
+            }
+            out.push_back(s->back().node->key);
+            s->pop_back();
+        }
+    }
+}
+
+// The new version starts out as base; the reference taken here is the one
+// own() moves over once the root gets copied.
+void PersistentTree::begin(VersionNode* base) {
+    ++edit;
+    retain(base);
+    root = base;
+}
+
+VersionNode* PersistentTree::finish() {
+    VersionNode* r = root;
+    root = nullptr;
+    return r;
+}
+
+VersionNode* PersistentTree::create(int k, int v) {
+    VersionNode* n = pool.create(k, v);
+    n->edit = edit;
+    return n;
+}
+
+// Returns a node of this edit in place of n. n stands for the reference
+// held by the pointer the result is stored into: a node of this edit is
+// already writable, any other one is copied and the reference moves over.
+VersionNode* PersistentTree::own(VersionNode* n) {
+    if (!n || n->edit == edit) return n;
+    VersionNode* c = pool.create(n->key, n->value);
+    c->height = n->height;
+    c->size = n->size;
+    c->red = n->red;
+    c->left = n->left;
+    c->right = n->right;
+    c->edit = edit;
+    retain(c->left);
+    retain(c->right);
+    release(n);
+    return c;
+}
+
+VersionNode* PersistentTree::ownChild(VersionNode* parent, bool right) {
+    VersionNode*& slot = right ? parent->right : parent->left;
+    slot = own(slot);
+    if (slot) slot->parent = parent;
+    return slot;
+}
+
+// Copies the path from the root to k, or to where k would hang, root first.
+void PersistentTree::ownPath(int k, std::vector<VersionNode*>& path) {
+    path.clear();
+    root = own(root);
+    if (root) root->parent = nullptr;
+    for (VersionNode* n = root; n; n = ownChild(n, k > n->key)) {
+        path.push_back(n);
+        if (n->key == k) break;
+    }
+}
+
+// Nodes of older versions are shared, so only this edit's nodes get
+// parent links; the others are never reached through one.
+void PersistentTree::setParent(VersionNode* child, VersionNode* parent) {
+    if (child && child->edit == edit) child->parent = parent;
+}
+
+VersionNode* PersistentTree::insert(VersionNode* base, int k, int v) {
+    begin(base);
+    add(k, v);
+    return finish();
+}
+
+// Same as BST::updateKey: rewritten in place when newKey keeps its place in
+// key order, otherwise removed and inserted again.
+VersionNode* PersistentTree::updateKey(VersionNode* base, int oldKey, int newKey) {
+    const VersionNode* n = find(base, oldKey);
+    if (!n || oldKey == newKey || find(base, newKey)) {
+        retain(base);
+        return base;
+    }
+
+    // Neighbours of oldKey: the closest ancestors on either side, unless
+    // the node has a subtree on that side.
+    const VersionNode* pred = nullptr;
+    const VersionNode* succ = nullptr;
+    for (const VersionNode* a = base; a != n; a = (oldKey < a->key) ? a->left : a->right) {
+        if (oldKey < a->key) succ = a;
+        else pred = a;
+    }
+    if (n->left) {
+        for (pred = n->left; pred->right; pred = pred->right) {}
+    }
+    if (n->right) {
+        for (succ = n->right; succ->left; succ = succ->left) {}
+    }
+
+    if ((!pred || pred->key < newKey) && (!succ || newKey < succ->key)) {
+        begin(base);
+        std::vector<VersionNode*> path;
+        ownPath(oldKey, path);
+        path.back()->key = newKey;
+        return finish();
+    }
+
+    int v = n->value;
+    VersionNode* removed = remove(base, oldKey);
+    VersionNode* result = insert(removed, newKey, v);
+    release(removed);
+    return result;
+}
+
+static void copyFields(VersionNode* to, const BSTNode* from) { to->height = from->height; }
+static void copyFields(VersionNode* to, const RBNode* from) { to->red = from->red; }
+static void copyFields(BSTNode* to, const VersionNode* from) { to->height = from->height; }
+static void copyFields(RBNode* to, const VersionNode* from) { to->red = from->red; }
+
+// Preorder with pending child links on a stack, like BST::loadBinary.
+template <typename Node>
+VersionNode* PersistentTree::captureTree(const Node* from) {
+    ++edit;
+    VersionNode* result = nullptr;
+    std::vector<std::pair<const Node*, VersionNode**>> stack;
+    if (from) stack.push_back({ from, &result });
+    while (!stack.empty()) {
+        const Node* n = stack.back().first;
+        VersionNode** slot = stack.back().second;
+        stack.pop_back();
+        VersionNode* c = create(n->key, n->value);
+        c->size = n->size;
+        copyFields(c, n);
+        *slot = c;
+        if (n->right) stack.push_back({ n->right, &c->right });
+        if (n->left) stack.push_back({ n->left, &c->left });
+    }
+    return result;
+}
+
+VersionNode* PersistentTree::capture(const BSTNode* root) {
+    return captureTree(root);
+}
+
+VersionNode* PersistentTree::capture(const RBNode* root) {
+    return captureTree(root);
+}
+
+template <typename Tree, typename Node>
+static void restoreTree(const VersionNode* from, Tree& tree) {
+    tree.clearTree();
+    std::vector<std::pair<const VersionNode*, Node*>> stack;   // (node, its parent)
+    if (from) stack.push_back({ from, nullptr });
+    while (!stack.empty()) {
+        const VersionNode* n = stack.back().first;
+        Node* parent = stack.back().second;
+        stack.pop_back();
+        Node* c = tree.pool.create(n->key, n->value);
+        c->size = n->size;
+        copyFields(c, n);
+        c->parent = parent;
+        if (!parent) tree.root = c;
+        else if (c->key < parent->key) parent->left = c;
+        else parent->right = c;
+        if (n->right) stack.push_back({ n->right, c });
+        if (n->left) stack.push_back({ n->left, c });
+    }
+}
+
+void PersistentTree::restore(const VersionNode* root, BST& tree) const {
+    restoreTree<BST, BSTNode>(root, tree);
+}
+
+void PersistentTree::restore(const VersionNode* root, RBTree& tree) const {
+    restoreTree<RBTree, RBNode>(root, tree);
+}
+
+int PersistentAVL::height(const VersionNode* n) {
+    return n ? n->height : 0;
+}
+
+int PersistentAVL::balanceFactor(const VersionNode* n) {
+    return height(n->left) - height(n->right);
+}
+
+void PersistentAVL::refresh(VersionNode* n) {
+    n->height = 1 + std::max(height(n->left), height(n->right));
+    n->size = 1 + sizeOf(n->left) + sizeOf(n->right);
+}
+
+// y belongs to this edit; the child moving up is copied first
+VersionNode* PersistentAVL::rightRotate(VersionNode* y) {
+    VersionNode* x = ownChild(y, false);
+    y->left = x->right;
+    x->right = y;
+    refresh(y);
+    refresh(x);
+    return x;
+}
+
+VersionNode* PersistentAVL::leftRotate(VersionNode* x) {
+    VersionNode* y = ownChild(x, true);
+    x->right = y->left;
+    y->left = x;
+    refresh(x);
+    refresh(y);
+    return y;
+}
+
+VersionNode* PersistentAVL::rebalance(VersionNode* node) {
+    refresh(node);
+    int bf = balanceFactor(node);
+    if (bf > 1) {
+        if (balanceFactor(node->left) >= 0)
+            return rightRotate(node);
+        node->left = leftRotate(ownChild(node, false));
+        return rightRotate(node);
+    }
+    else if (bf < -1) {
+        if (balanceFactor(node->right) <= 0)
+            return leftRotate(node);
+        node->right = rightRotate(ownChild(node, true));
+        return leftRotate(node);
+    }
+    return node;
+}
+
+// Rebalances the copied path bottom-up, hanging each result where the old
+// subtree root was, and returns what ends up on top.
+VersionNode* PersistentAVL::retrace(const std::vector<VersionNode*>& path) {
+    VersionNode* sub = nullptr;
+    for (int i = (int)path.size() - 1; i >= 0; --i) {
+        sub = rebalance(path[i]);
+        if (i == 0) break;
+        if (path[i - 1]->left == path[i]) path[i - 1]->left = sub;
+        else path[i - 1]->right = sub;
+    }
+    return sub;
+}
+
+// Same rotations as AVL::insertRec, done bottom-up along the copied path
+void PersistentAVL::add(int k, int v) {
+    if (find(root, k)) return;
+
+    std::vector<VersionNode*> path;
+    ownPath(k, path);
+    VersionNode* n = create(k, v);
+    if (path.empty()) {
+        root = n;
+        return;
+    }
+    if (k < path.back()->key) path.back()->left = n;
+    else path.back()->right = n;
+    root = retrace(path);
+}
+
+// Same as AVL::removeRec: a node with two children takes its successor's
+// key and the successor is unlinked instead.
+VersionNode* PersistentAVL::remove(VersionNode* base, int k) {
+    begin(base);
+    if (!find(root, k)) return finish();
+
+    std::vector<VersionNode*> path;
+    ownPath(k, path);
+    VersionNode* z = path.back();
+    VersionNode* gone;
+    VersionNode* child;
+    if (z->left && z->right) {
+        gone = ownChild(z, true);
+        while (gone->left) {
+            path.push_back(gone);
+            gone = ownChild(gone, false);
+        }
+        z->key = gone->key;
+        z->value = gone->value;
+        child = gone->right;
+    }
+    else {
+        path.pop_back();
+        gone = z;
+        child = z->left ? z->left : z->right;
+    }
+
+    // The child's reference moves from the removed node to its parent
+    if (path.empty()) root = child;
+    else if (path.back()->left == gone) path.back()->left = child;
+    else path.back()->right = child;
+    pool.destroy(gone);
+    if (!path.empty()) root = retrace(path);
+    return finish();
+}
+
+// BST::buildBalanced: the batch becomes a balanced tree of this edit
+VersionNode* PersistentAVL::build(const std::vector<int>& keys, int lo, int hi) {
+    if (lo > hi) return nullptr;
+    int mid = lo + (hi - lo) / 2;
+    VersionNode* n = create(keys[mid], keys[mid]);
+    n->left = build(keys, lo, mid - 1);
+    n->right = build(keys, mid + 1, hi);
+    refresh(n);
+    return n;
+}
+
+// AVL::joinNodes. k belongs to this edit; the nodes passed on the way down
+// the taller side's inner spine are copied and rebalanced bottom-up.
+VersionNode* PersistentAVL::joinNodes(VersionNode* l, VersionNode* k, VersionNode* r) {
+    if (std::abs(height(l) - height(r)) <= 1) {
+        k->left = l;
+        k->right = r;
+        refresh(k);
+        return k;
+    }
+
+    // The taller side's root is always above the limit, so it is on the path
+    bool intoLeft = height(l) > height(r);
+    int limit = height(intoLeft ? r : l) + 1;
+    std::vector<VersionNode*> path;
+    VersionNode* p = own(intoLeft ? l : r);
+    path.push_back(p);
+    VersionNode* c = intoLeft ? p->right : p->left;
+    while (height(c) > limit) {
+        p = ownChild(p, intoLeft);
+        path.push_back(p);
+        c = intoLeft ? p->right : p->left;
+    }
+    if (intoLeft) {
+        k->left = c;
+        k->right = r;
+        p->right = k;
+    }
+    else {
+        k->left = l;
+        k->right = c;
+        p->left = k;
+    }
+    refresh(k);
+    return retrace(path);
+}
+
+// AVL::splitNodes, copying the nodes on the way down to k
+VersionNode* PersistentAVL::splitNodes(VersionNode* t, int k, VersionNode*& l, VersionNode*& r) {
+    if (!t) {
+        l = r = nullptr;
+        return nullptr;
+    }
+    t = own(t);
+    VersionNode* below = t->left;
+    VersionNode* above = t->right;
+    t->left = t->right = nullptr;
+
+    if (k == t->key) {
+        l = below;
+        r = above;
+        refresh(t);
+        return t;
+    }
+    VersionNode* found;
+    VersionNode* mid;
+    if (k < t->key) {
+        found = splitNodes(below, k, l, mid);
+        r = joinNodes(mid, t, above);
+    }
+    else {
+        found = splitNodes(above, k, mid, r);
+        l = joinNodes(below, t, mid);
+    }
+    return found;
+}
+
+// AVL::combine for a union, run sequentially; the order of the joins does
+// not depend on how AVL spreads them over threads.
+VersionNode* PersistentAVL::unite(VersionNode* a, VersionNode* b) {
+    if (!a || !b) return a ? a : b;
+    a = own(a);
+    VersionNode* below = a->left;
+    VersionNode* above = a->right;
+    a->left = a->right = nullptr;
+
+    VersionNode* l, * r;
+    VersionNode* found = splitNodes(b, a->key, l, r);
+    VersionNode* left = unite(below, l);
+    VersionNode* right = unite(above, r);
+    release(found);
+    return joinNodes(left, a, right);
+}
+
+// AVL::insertBatch: the batch is built balanced and unioned in, so the
+// version copies O(m log(n/m + 1)) nodes for m keys, not a path per key.
+VersionNode* PersistentAVL::insertBatch(VersionNode* base, const std::vector<int>& sorted) {
+    begin(base);
+    root = unite(root, build(sorted, 0, static_cast<int>(sorted.size()) - 1));
+    return finish();
+}
+
+void PersistentRB::updateSize(VersionNode* n) {
+    n->size = 1 + sizeOf(n->left) + sizeOf(n->right);
+}
+
+void PersistentRB::updateSizesUpward(VersionNode* n) {
+    for (; n; n = n->parent)
+        updateSize(n);
+}
+
+void PersistentRB::leftRotate(VersionNode* x) {
+    VersionNode* y = ownChild(x, true);
+    x->right = y->left;
+    setParent(y->left, x);
+    y->parent = x->parent;
+    if (!x->parent) root = y;
+    else if (x == x->parent->left) x->parent->left = y;
+    else x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+    y->size = x->size;
+    updateSize(x);
+}
+
+void PersistentRB::rightRotate(VersionNode* y) {
+    VersionNode* x = ownChild(y, false);
+    y->left = x->right;
+    setParent(x->right, y);
+    x->parent = y->parent;
+    if (!y->parent) root = x;
+    else if (y == y->parent->left) y->parent->left = x;
+    else y->parent->right = x;
+    x->right = y;
+    y->parent = x;
+    x->size = y->size;
+    updateSize(y);
+}
+
+// RBTree::tryInsert and insertFixup on a copied path
+void PersistentRB::add(int k, int v) {
+    if (find(root, k)) return;
+
+    std::vector<VersionNode*> path;
+    ownPath(k, path);
+    VersionNode* y = path.empty() ? nullptr : path.back();
+    VersionNode* z = create(k, v);
+    z->parent = y;
+    if (!y) root = z;
+    else if (k < y->key) y->left = z;
+    else y->right = z;
+    updateSizesUpward(y);
+    insertFixup(z);
+}
+
+// z and its ancestors belong to this edit; an uncle is copied before it
+// is recolored.
+void PersistentRB::insertFixup(VersionNode* z) {
+    while (z->parent && z->parent->red) {
+        VersionNode* g = z->parent->parent;
+        bool parentIsLeft = z->parent == g->left;
+        VersionNode* y = parentIsLeft ? g->right : g->left;
+        if (y && y->red) {
+            y = ownChild(g, parentIsLeft);
+            z->parent->red = false;
+            y->red = false;
+            g->red = true;
+            z = g;
+        }
+        else if (parentIsLeft) {
+            if (z == z->parent->right) {
+                z = z->parent;
+                leftRotate(z);
+            }
+            z->parent->red = false;
+            z->parent->parent->red = true;
+            rightRotate(z->parent->parent);
+        }
+        else {
+            if (z == z->parent->left) {
+                z = z->parent;
+                rightRotate(z);
+            }
+            z->parent->red = false;
+            z->parent->parent->red = true;
+            leftRotate(z->parent->parent);
+        }
+    }
+    if (root) root->red = false;
+}
+
+void PersistentRB::transplant(VersionNode* u, VersionNode* v) {
+    if (!u->parent) root = v;
+    else if (u == u->parent->left) u->parent->left = v;
+    else u->parent->right = v;
+    setParent(v, u->parent);
+}
+
+// RBTree::remove; the successor's path is copied as well
+VersionNode* PersistentRB::remove(VersionNode* base, int k) {
+    begin(base);
+    if (!find(root, k)) return finish();
+
+    std::vector<VersionNode*> path;
+    ownPath(k, path);
+    VersionNode* z = path.back();
+    VersionNode* y = z;
+    VersionNode* x;
+    VersionNode* xParent;
+    bool yOriginalRed = y->red;
+
+    // Lowest node whose subtree loses a node once z is unlinked
+    VersionNode* changed = z->parent;
+
+    if (!z->left) {
+        x = z->right;
+        xParent = z->parent;
+        transplant(z, z->right);
+    }
+    else if (!z->right) {
+        x = z->left;
+        xParent = z->parent;
+        transplant(z, z->left);
+    }
+    else {
+        y = ownChild(z, true);
+        while (y->left) y = ownChild(y, false);
+        changed = (y->parent == z) ? y : y->parent;
+        yOriginalRed = y->red;
+        x = y->right;
+        if (y->parent == z) {
+            setParent(x, y);
+            xParent = y;
+        }
+        else {
+            xParent = y->parent;
+            transplant(y, y->right);
+            y->right = z->right;
+            setParent(y->right, y);
+        }
+        transplant(z, y);
+        y->left = z->left;
+        setParent(y->left, y);
+        y->red = z->red;
+    }
+    pool.destroy(z);
+    updateSizesUpward(changed);
+    if (!yOriginalRed) deleteFixup(x, xParent);
+    return finish();
+}
+
+// x may still be a shared node, so it is compared by address and copied
+// only if it has to be recolored. Siblings and nephews are copied before
+// they change.
+void PersistentRB::deleteFixup(VersionNode* x, VersionNode* xParent) {
+    while (x != root && (!x || !x->red)) {
+        if (x == xParent->left) {
+            VersionNode* w = ownChild(xParent, true);
+            if (w && w->red) {
+                w->red = false;
+                xParent->red = true;
+                leftRotate(xParent);
+                w = ownChild(xParent, true);
+            }
+            if (w && (!w->left || !w->left->red) && (!w->right || !w->right->red)) {
+                w->red = true;
+                x = xParent;
+                xParent = x ? x->parent : nullptr;
+            }
+            else if (w) {
+                if (!w->right || !w->right->red) {
+                    if (w->left) ownChild(w, false)->red = false;
+                    w->red = true;
+                    rightRotate(w);
+                    w = ownChild(xParent, true);
+                }
+                w->red = xParent->red;
+                xParent->red = false;
+                if (w->right) ownChild(w, true)->red = false;
+                leftRotate(xParent);
+                x = root;
+            }
+        }
+        else {
+            VersionNode* w = ownChild(xParent, false);
+            if (w && w->red) {
+                w->red = false;
+                xParent->red = true;
+                rightRotate(xParent);
+                w = ownChild(xParent, false);
+            }
+            if (w && (!w->right || !w->right->red) && (!w->left || !w->left->red)) {
+                w->red = true;
+                x = xParent;
+                xParent = x ? x->parent : nullptr;
+            }
+            else if (w) {
+                if (!w->left || !w->left->red) {
+                    if (w->right) ownChild(w, true)->red = false;
+                    w->red = true;
+                    leftRotate(w);
+                    w = ownChild(xParent, false);
+                }
+                w->red = xParent->red;
+                xParent->red = false;
+                if (w->left) ownChild(w, false)->red = false;
+                rightRotate(xParent);
+                x = root;
+            }
+        }
+    }
+    if (x && x->red) {
+        if (x == root) x = root = own(root);
+        else x = ownChild(xParent, x == xParent->right);
+        x->red = false;
+    }
+}
+
+int PersistentRB::blackHeight(const VersionNode* n) {
+    int h = 0;
+    for (; n; n = n->left)
+        if (!n->red) h++;
+    return h;
+}
+
+// RBTree::buildBalanced, coloring included
+VersionNode* PersistentRB::build(const std::vector<int>& keys, int lo, int hi, int depth, int redDepth) {
+    if (lo > hi) return nullptr;
+    int mid = lo + (hi - lo) / 2;
+    VersionNode* n = create(keys[mid], keys[mid]);
+    n->red = (depth == redDepth && depth > 0);
+    n->left = build(keys, lo, mid - 1, depth + 1, redDepth);
+    n->right = build(keys, mid + 1, hi, depth + 1, redDepth);
+    updateSize(n);
+    return n;
+}
+
+// RBTree::joinNodes. k belongs to this edit; the nodes passed on the way
+// down the taller side's inner spine are copied, which also gives them the
+// parent links insertFixup climbs. Rotations at the top point root at the
+// result, as in RBTree.
+VersionNode* PersistentRB::joinNodes(VersionNode* l, int bl, VersionNode* k, VersionNode* r, int br, int& bh) {
+    if (l && l->red) {
+        l = own(l);
+        l->red = false;
+        bl++;
+    }
+    if (r && r->red) {
+        r = own(r);
+        r->red = false;
+        br++;
+    }
+    k->parent = nullptr;
+    if (bl == br) {
+        k->left = l;
+        k->right = r;
+        setParent(l, k);
+        setParent(r, k);
+        k->red = false;
+        updateSize(k);
+        bh = bl + 1;
+        return k;
+    }
+
+    // The taller side's root is black and above the target, so it is the
+    // first node passed
+    bool intoLeft = bl > br;
+    int target = intoLeft ? br : bl;
+    int h = (intoLeft ? bl : br) - 1;
+    VersionNode* top = own(intoLeft ? l : r);
+    top->parent = nullptr;
+    VersionNode* p = top;
+    VersionNode* c = intoLeft ? p->right : p->left;
+    while (c && (c->red || h > target)) {
+        if (!c->red) h--;
+        p = ownChild(p, intoLeft);
+        c = intoLeft ? p->right : p->left;
+    }
+    if (intoLeft) {
+        k->left = c;
+        k->right = r;
+        p->right = k;
+    }
+    else {
+        k->left = l;
+        k->right = c;
+        p->left = k;
+    }
+    k->parent = p;
+    setParent(k->left, k);
+    setParent(k->right, k);
+    k->red = true;
+    updateSize(k);
+    updateSizesUpward(p);
+
+    root = top;
+    insertFixup(k);
+    bh = target;
+    for (VersionNode* n = k; n; n = n->parent)
+        if (!n->red) bh++;
+    return root;
+}
+
+// RBTree::splitNodes, copying the nodes on the way down to k
+VersionNode* PersistentRB::splitNodes(VersionNode* t, int bh, int k, VersionNode*& l, int& bl, VersionNode*& r, int& br) {
+    if (!t) {
+        l = r = nullptr;
+        bl = br = 0;
+        return nullptr;
+    }
+    t = own(t);
+    int childBh = t->red ? bh : bh - 1;
+    VersionNode* below = t->left;
+    VersionNode* above = t->right;
+    t->left = t->right = t->parent = nullptr;
+
+    if (k == t->key) {
+        l = below;
+        r = above;
+        bl = br = childBh;
+        updateSize(t);
+        return t;
+    }
+    VersionNode* found;
+    VersionNode* mid;
+    int bMid;
+    if (k < t->key) {
+        found = splitNodes(below, childBh, k, l, bl, mid, bMid);
+        r = joinNodes(mid, bMid, t, above, childBh, br);
+    }
+    else {
+        found = splitNodes(above, childBh, k, mid, bMid, r, br);
+        l = joinNodes(below, childBh, t, mid, bMid, bl);
+    }
+    return found;
+}
+
+// RBTree::combine for a union, run sequentially like PersistentAVL::unite
+VersionNode* PersistentRB::unite(VersionNode* a, int ba, VersionNode* b, int bb, int& bh) {
+    if (!a || !b) {
+        bh = a ? ba : bb;
+        return a ? a : b;
+    }
+    a = own(a);
+    int childBh = a->red ? ba : ba - 1;
+    VersionNode* below = a->left;
+    VersionNode* above = a->right;
+    a->left = a->right = nullptr;
+
+    VersionNode* l, * r;
+    int bl, br;
+    VersionNode* found = splitNodes(b, bb, a->key, l, bl, r, br);
+    int bLeft, bRight;
+    VersionNode* left = unite(below, childBh, l, bl, bLeft);
+    VersionNode* right = unite(above, childBh, r, br, bRight);
+    release(found);
+    return joinNodes(left, bLeft, a, right, bRight, bh);
+}
+
+// RBTree::insertBatch. root is the joins' scratch pointer, so the base
+// version is held aside while they run.
+VersionNode* PersistentRB::insertBatch(VersionNode* base, const std::vector<int>& sorted) {
+    begin(base);
+    VersionNode* a = root;
+    root = nullptr;
+    int n = static_cast<int>(sorted.size());
+    int redDepth = 0;
+    while ((2 << redDepth) <= n) redDepth++;
+    VersionNode* b = build(sorted, 0, n - 1, 0, redDepth);
+
+    int bh;
+    VersionNode* merged = unite(a, blackHeight(a), b, blackHeight(b), bh);
+    if (merged && merged->red) {
+        merged = own(merged);
+        merged->red = false;
+    }
+    root = merged;
+    return finish();
+}
+
+VersionHistory::VersionHistory(PersistentTree& tree, int limit)
+    : versions(tree), roots(1, nullptr), index(0), limit(std::max(1, limit)) {
+}
+
+VersionHistory::~VersionHistory() {
+    for (VersionNode* r : roots) versions.release(r);
+}
+
+void VersionHistory::commit(VersionNode* root) {
+    for (int i = index + 1; i < count(); ++i) versions.release(roots[i]);
+    roots.resize(index + 1);
+    roots.push_back(root);
+    if (count() > limit) {
+        versions.release(roots.front());
+        roots.erase(roots.begin());
+    }
+    index = count() - 1;
+}
+
+void VersionHistory::reset(VersionNode* root) {
+    for (VersionNode* r : roots) versions.release(r);
+    roots.assign(1, root);
+    index = 0;
+}
+
+bool VersionHistory::checkout(int i) {
+    if (i < 0 || i >= count()) return false;
+    index = i;
+    return true;
+}
\ No newline at end of file
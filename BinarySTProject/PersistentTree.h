@@ -0,0 +1,155 @@
+#ifndef PERSISTENTTREE_H
+#define PERSISTENTTREE_H
+
+#include <vector>
+#include "NodePool.h"
+#include "BST.h"
+#include "RBTree.h"
+
+// Node of a persistent tree. A published version is never written again:
+// an edit copies the nodes on the paths it changes and shares every other
+// subtree with the version it started from, so each version costs
+// O(log n) new nodes.
+struct VersionNode {
+    int key, value;
+    int height;     // AVL only
+    int size;       // number of nodes in this subtree
+    bool red;       // RB only
+    VersionNode* left;
+    VersionNode* right;
+    VersionNode* parent;    // only valid for nodes of the edit in progress
+    int refs;               // parents and versions pointing here
+    unsigned edit;          // edit that created the node
+    VersionNode(int k = 0, int v = 0);
+};
+
+// Path copying shared by PersistentAVL and PersistentRB. Functions taking a
+// base version leave it untouched and return the root of the new version,
+// which holds one reference that the caller gives back with release().
+// The edits make the same decisions as AVL and RBTree, so a version has
+// exactly the shape the editable tree had after the same operations.
+class PersistentTree {
+public:
+    PersistentTree();
+    virtual ~PersistentTree();
+
+    void retain(VersionNode* n);
+    void release(VersionNode* n);
+
+    static int sizeOf(const VersionNode* n);
+    static const VersionNode* find(const VersionNode* root, int k);
+    static void diff(const VersionNode* from, const VersionNode* to,
+                     std::vector<int>& removed, std::vector<int>& added);
+
+    VersionNode* insert(VersionNode* base, int k, int v);
+    virtual VersionNode* remove(VersionNode* base, int k) = 0;
+    // Strictly increasing keys, merged in like the trees' insertBatch does
+    virtual VersionNode* insertBatch(VersionNode* base, const std::vector<int>& sorted) = 0;
+    VersionNode* updateKey(VersionNode* base, int oldKey, int newKey);
+
+    // Shape copies between versions and the editable trees, O(n)
+    VersionNode* capture(const BSTNode* root);
+    VersionNode* capture(const RBNode* root);
+    void restore(const VersionNode* root, BST& tree) const;
+    void restore(const VersionNode* root, RBTree& tree) const;
+
+protected:
+    NodePool<VersionNode> pool;
+    unsigned edit;
+    VersionNode* root;      // root of the version being built
+
+    void begin(VersionNode* base);
+    VersionNode* finish();
+    virtual void add(int k, int v) = 0;    // one insert into the edit in progress
+    VersionNode* create(int k, int v);
+    VersionNode* own(VersionNode* n);
+    VersionNode* ownChild(VersionNode* parent, bool right);
+    void ownPath(int k, std::vector<VersionNode*>& path);
+    void setParent(VersionNode* child, VersionNode* parent);
+
+    template <typename Node>
+    VersionNode* captureTree(const Node* root);
+};
+
+class PersistentAVL : public PersistentTree {
+public:
+    VersionNode* remove(VersionNode* base, int k) override;
+    VersionNode* insertBatch(VersionNode* base, const std::vector<int>& sorted) override;
+
+protected:
+    void add(int k, int v) override;
+
+private:
+    static int height(const VersionNode* n);
+    static int balanceFactor(const VersionNode* n);
+    static void refresh(VersionNode* n);
+    VersionNode* rightRotate(VersionNode* y);
+    VersionNode* leftRotate(VersionNode* x);
+    VersionNode* rebalance(VersionNode* n);
+    VersionNode* retrace(const std::vector<VersionNode*>& path);
+
+    // AVL's batch union on subtrees this edit owns a reference to
+    VersionNode* build(const std::vector<int>& keys, int lo, int hi);
+    VersionNode* joinNodes(VersionNode* l, VersionNode* k, VersionNode* r);
+    VersionNode* splitNodes(VersionNode* t, int k, VersionNode*& l, VersionNode*& r);
+    VersionNode* unite(VersionNode* a, VersionNode* b);
+};
+
+class PersistentRB : public PersistentTree {
+public:
+    VersionNode* remove(VersionNode* base, int k) override;
+    VersionNode* insertBatch(VersionNode* base, const std::vector<int>& sorted) override;
+
+protected:
+    void add(int k, int v) override;
+
+private:
+    static void updateSize(VersionNode* n);
+    static void updateSizesUpward(VersionNode* n);
+    void leftRotate(VersionNode* x);
+    void rightRotate(VersionNode* y);
+    void transplant(VersionNode* u, VersionNode* v);
+    void insertFixup(VersionNode* z);
+    void deleteFixup(VersionNode* x, VersionNode* xParent);
+
+    // RBTree's batch union on subtrees this edit owns a reference to
+    static int blackHeight(const VersionNode* n);
+    VersionNode* build(const std::vector<int>& keys, int lo, int hi, int depth, int redDepth);
+    VersionNode* joinNodes(VersionNode* l, int bl, VersionNode* k, VersionNode* r, int br, int& bh);
+    VersionNode* splitNodes(VersionNode* t, int bh, int k, VersionNode*& l, int& bl, VersionNode*& r, int& br);
+    VersionNode* unite(VersionNode* a, int ba, VersionNode* b, int bb, int& bh);
+};
+
+// Versions of one tree, oldest first, and which one is current. Committing
+// on top of an older version drops the versions after it, like an editor's
+// undo stack. At most limit versions are kept.
+class VersionHistory {
+public:
+    VersionHistory(PersistentTree& tree, int limit = 1000);
+    ~VersionHistory();
+    VersionHistory(const VersionHistory&) = delete;
+    VersionHistory& operator=(const VersionHistory&) = delete;
+
+    PersistentTree& tree() { return versions; }
+    VersionNode* current() const { return roots[index]; }
+    int currentIndex() const { return index; }
+    int count() const { return (int)roots.size(); }
+
+    void commit(VersionNode* root);    // takes over the root's reference
+    void reset(VersionNode* root);     // forgets everything else
+    bool checkout(int i);
+
+    void insert(int k, int v) { commit(versions.insert(current(), k, v)); }
+    void insertBatch(const std::vector<int>& sorted) { commit(versions.insertBatch(current(), sorted)); }
+    void remove(int k) { commit(versions.remove(current(), k)); }
+    void updateKey(int oldKey, int newKey) { commit(versions.updateKey(current(), oldKey, newKey)); }
+    void clear() { commit(nullptr); }
+
+private:
+    PersistentTree& versions;
+    std::vector<VersionNode*> roots;
+    int index;
+    int limit;
+};
+
+#endif // PERSISTENTTREE_H
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "PublishedTree.h"
+#include <thread>
+
+PublishedTree::PublishedTree(PersistentTree& tree) : versions(tree), current(nullptr) {}
+
+PublishedTree::~PublishedTree() {
+    versions.release(current.load(std::memory_order_relaxed));
+}
+
+// The new root gets a reference of its own, so the writer may drop the
+// version from its history while readers still walk it.
+void PublishedTree::publish(VersionNode* root) {
+    versions.retain(root);
+    VersionNode* old = current.exchange(root, std::memory_order_seq_cst);
+    if (old == root) {
+        versions.release(old);
+    }
+    else if (old) {
+        PersistentTree& tree = versions;
+        epochs.retire([&tree, old] { tree.release(old); });
+    }
+    epochs.collect();
+}
+
+PublishedTree::Reader::Reader(PublishedTree& published) : published(published), slot(-1) {
+    while ((slot = published.epochs.attach()) < 0)
+        std::this_thread::yield();
+}
+
+PublishedTree::Reader::~Reader() {
+    published.epochs.detach(slot);
+}
+
+const VersionNode* PublishedTree::Reader::enter() {
+    published.epochs.enter(slot);
+    return published.current.load(std::memory_order_seq_cst);
+}
+
+void PublishedTree::Reader::leave() {
+    published.epochs.leave(slot);
+}
+
+bool PublishedTree::Reader::search(int k) {
+    bool found = PersistentTree::find(enter(), k) != nullptr;
+    leave();
+    return found;
+}
+
+int PublishedTree::Reader::size() {
+    int n = PersistentTree::sizeOf(enter());
+    leave();
+    return n;
+}
+
+// Keys below k (or up to k when inclusive), from the subtree sizes
+static int countBelow(const VersionNode* n, int k, bool inclusive) {
+    int r = 0;
+    while (n) {
+        if (k < n->key || (!inclusive && k == n->key)) {
+            n = n->left;
+        }
+        else {
+            r += PersistentTree::sizeOf(n->left) + 1;
+            n = n->right;
+        }
+    }
+    return r;
+}
+
+int PublishedTree::Reader::rank(int k) {
+    int r = countBelow(enter(), k, false);
+    leave();
+    return r;
+}
+
+int PublishedTree::Reader::rangeCount(int lo, int hi) {
+    if (lo > hi) return 0;
+    const VersionNode* root = enter();
+    int n = countBelow(root, hi, true) - countBelow(root, lo, false);
+    leave();
+    return n;
+}
+
+std::vector<int> PublishedTree::Reader::inorderKeys() {
+    std::vector<int> keys;
+    std::vector<const VersionNode*> stack;
+    const VersionNode* n = enter();
+    keys.reserve(PersistentTree::sizeOf(n));
+    while (n || !stack.empty()) {
+        if (n) {
+            stack.push_back(n);
+            n = n->left;
+        }
+        else {
+            n = stack.back();
+            stack.pop_back();
+            keys.push_back(n->key);
+            n = n->right;
+        }
+    }
+    leave();
+    return keys;
+}
+
+// Only descends into subtrees that can hold keys in [lo, hi]
+std::vector<int> PublishedTree::Reader::rangeKeys(int lo, int hi) {
+    std::vector<int> keys;
+    std::vector<const VersionNode*> stack;
+    const VersionNode* n = enter();
+    while (n || !stack.empty()) {
+        if (n) {
+            stack.push_back(n);
+            n = lo < n->key ? n->left : nullptr;
+        }
+        else {
+            n = stack.back();
+            stack.pop_back();
+            if (n->key > hi) break;
+            if (n->key >= lo) keys.push_back(n->key);
+            n = n->right;
+        }
+    }
+    leave();
+    return keys;
+}
\ No newline at end of file
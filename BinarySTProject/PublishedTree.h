@@ -0,0 +1,55 @@
+#ifndef PUBLISHEDTREE_H
+#define PUBLISHEDTREE_H
+
+#include <atomic>
+#include <vector>
+#include "EpochReclaimer.h"
+#include "PersistentTree.h"
+
+// Latest version of a persistent tree, for readers on other threads.
+//
+// The writer publishes a version with one atomic store; readers load the
+// root and walk nodes nobody writes any more, so they take no locks and
+// never wait for the writer or each other. A replaced version is only
+// released once no reader can still be inside it (see EpochReclaimer).
+class PublishedTree {
+public:
+    explicit PublishedTree(PersistentTree& tree);
+    ~PublishedTree();
+    PublishedTree(const PublishedTree&) = delete;
+    PublishedTree& operator=(const PublishedTree&) = delete;
+
+    // Writer thread only, the one that edits tree
+    void publish(VersionNode* root);
+
+    // One per reader thread. Waits for a free slot when EpochReclaimer::MaxReaders
+    // readers exist already.
+    class Reader {
+    public:
+        explicit Reader(PublishedTree& published);
+        ~Reader();
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool search(int k);
+        int size();
+        int rank(int k);
+        int rangeCount(int lo, int hi);
+        std::vector<int> inorderKeys();
+        std::vector<int> rangeKeys(int lo, int hi);
+
+    private:
+        PublishedTree& published;
+        int slot;
+
+        const VersionNode* enter();
+        void leave();
+    };
+
+private:
+    PersistentTree& versions;
+    EpochReclaimer epochs;
+    std::atomic<VersionNode*> current;
+};
+
+#endif // PUBLISHEDTREE_H
\ No newline at end of file
@@ -1,22 +1,34 @@
 #include "RBTree.h"
+#include "ParallelSort.h"
+#include "WorkStealingPool.h"
 #include <fstream>
 #include <algorithm>
+#include <limits>
+
+// Set operation steps on fewer nodes than this run sequentially
+static const int parallelGrain = 4096;
 
 RBNode::RBNode(int k, int v)
-    : key(k), value(v), left(nullptr), right(nullptr), parent(nullptr), red(true) {
+    : key(k), value(v), size(1), left(nullptr), right(nullptr), parent(nullptr), red(true) {
 }
 
 RBTree::RBTree() : root(nullptr) {}
 
-RBTree::~RBTree() {
-    clear(root);
-}
+// Nodes live in the pool, which releases its slabs on destruction.
+RBTree::~RBTree() {}
 
+// Returns the subtree rooted at n to the pool. Uses an explicit stack so
+// that degenerate (chain-shaped) trees cannot overflow the call stack.
 void RBTree::clear(RBNode* n) {
-    if (!n) return;
-    clear(n->left);
-    clear(n->right);
-    delete n;
+    std::vector<RBNode*> stack;
+    if (n) stack.push_back(n);
+    while (!stack.empty()) {
+        RBNode* cur = stack.back();
+        stack.pop_back();
+        if (cur->left) stack.push_back(cur->left);
+        if (cur->right) stack.push_back(cur->right);
+        pool.destroy(cur);
+    }
 }
 
 RBTree::SearchResult::SearchResult()
@@ -27,10 +39,29 @@ RBTree::SearchResult::SearchResult(bool f, int d)
     : found(f), depth(d) {
 }
 
+RBTree::InsertResult::InsertResult()
+    : inserted(false), node(nullptr), depth(-1) {
+}
+
+RBTree::InsertResult::InsertResult(bool i, RBNode* n, int d)
+    : inserted(i), node(n), depth(d) {
+}
+
+int RBTree::depthOf(RBNode* n) {
+    int depth = 0;
+    while (n && n->parent) {
+        n = n->parent;
+        depth++;
+    }
+    return depth;
+}
+
 RBTree::SearchResult RBTree::search(int k) {
     RBNode* cur = root;
     int depth = 0;
     while (cur) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
         if (cur->key == k) return SearchResult(true, depth);
         cur = (k < cur->key) ? cur->left : cur->right;
         depth++;
@@ -38,6 +69,13 @@ RBTree::SearchResult RBTree::search(int k) {
     return SearchResult(false, -1);
 }
 
+void RBTree::setRed(RBNode* n, bool red) {
+    if (n->red == red) return;
+    n->red = red;
+    TREE_STAT(recolorings);
+    changes.record(TreeChange::Recolored, n->key, red ? 1 : 0);
+}
+
 void RBTree::leftRotate(RBNode* x) {
     RBNode* y = x->right;
     x->right = y->left;
@@ -48,6 +86,10 @@ void RBTree::leftRotate(RBNode* x) {
     else x->parent->right = y;
     y->left = x;
     x->parent = y;
+    y->size = x->size;
+    updateSize(x);
+    TREE_STAT(rotations);
+    changes.record(TreeChange::Rotated, x->key, y->key);
 }
 
 void RBTree::rightRotate(RBNode* y) {
@@ -60,38 +102,54 @@ void RBTree::rightRotate(RBNode* y) {
     else y->parent->right = x;
     x->right = y;
     y->parent = x;
+    x->size = y->size;
+    updateSize(y);
+    TREE_STAT(rotations);
+    changes.record(TreeChange::Rotated, y->key, x->key);
 }
 
-void RBTree::insert(int k, int v) {
-
-    SearchResult existing = search(k);
-    if (existing.found) {
-        return;  // Reject duplicate
-    }
-
-    RBNode* z = new RBNode(k, v);
+// Finds the key or its insertion point in one walk down the tree.
+RBTree::InsertResult RBTree::tryInsert(int k, int v) {
     RBNode* y = nullptr, * x = root;
+    int depth = 0;
     while (x) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
+        if (k == x->key)
+            return InsertResult(false, x, depth);  // Reject duplicate
         y = x;
-        x = (z->key < x->key) ? x->left : x->right;
+        x = (k < x->key) ? x->left : x->right;
+        depth++;
     }
+
+    RBNode* z = pool.create(k, v);
+    TREE_STAT(allocations);
     z->parent = y;
     if (!y) root = z;
     else if (z->key < y->key) y->left = z;
     else y->right = z;
     z->left = z->right = nullptr;
     z->red = true;
+    updateSizesUpward(y);
+    changes.record(TreeChange::Created, k);
     insertFixup(z);
+    // Fixup rotations may have moved the new node
+    return InsertResult(true, z, depthOf(z));
+}
+
+void RBTree::insert(int k, int v) {
+    tryInsert(k, v);
 }
 
 void RBTree::insertFixup(RBNode* z) {
     while (z->parent && z->parent->red) {
+        TREE_STAT(visited);
         if (z->parent == z->parent->parent->left) {
             RBNode* y = z->parent->parent->right;
             if (y && y->red) {
-                z->parent->red = false;
-                y->red = false;
-                z->parent->parent->red = true;
+                setRed(z->parent, false);
+                setRed(y, false);
+                setRed(z->parent->parent, true);
                 z = z->parent->parent;
             }
             else {
@@ -99,17 +157,17 @@ void RBTree::insertFixup(RBNode* z) {
                     z = z->parent;
                     leftRotate(z);
                 }
-                z->parent->red = false;
-                z->parent->parent->red = true;
+                setRed(z->parent, false);
+                setRed(z->parent->parent, true);
                 rightRotate(z->parent->parent);
             }
         }
         else {
             RBNode* y = z->parent->parent->left;
             if (y && y->red) {
-                z->parent->red = false;
-                y->red = false;
-                z->parent->parent->red = true;
+                setRed(z->parent, false);
+                setRed(y, false);
+                setRed(z->parent->parent, true);
                 z = z->parent->parent;
             }
             else {
@@ -117,21 +175,79 @@ void RBTree::insertFixup(RBNode* z) {
                     z = z->parent;
                     rightRotate(z);
                 }
-                z->parent->red = false;
-                z->parent->parent->red = true;
+                setRed(z->parent, false);
+                setRed(z->parent->parent, true);
                 leftRotate(z->parent->parent);
             }
         }
     }
-    if (root) root->red = false;
+    if (root) setRed(root, false);
 }
 
 RBNode* RBTree::minimum(RBNode* n) {
-    while (n && n->left)
+    while (n && n->left) {
+        TREE_STAT(visited);
         n = n->left;
+    }
+    return n;
+}
+
+RBNode* RBTree::maximum(RBNode* n) {
+    while (n && n->right) {
+        TREE_STAT(visited);
+        n = n->right;
+    }
     return n;
 }
 
+RBNode* RBTree::find(int k) {
+    RBNode* n = root;
+    while (n) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
+        if (n->key == k) break;
+        n = (k < n->key) ? n->left : n->right;
+    }
+    return n;
+}
+
+RBNode* RBTree::predecessor(RBNode* n) {
+    if (n->left) return maximum(n->left);
+    while (n->parent && n == n->parent->left)
+        n = n->parent;
+    return n->parent;
+}
+
+RBNode* RBTree::successor(RBNode* n) {
+    if (n->right) return minimum(n->right);
+    while (n->parent && n == n->parent->right)
+        n = n->parent;
+    return n->parent;
+}
+
+// Changes oldKey to newKey in O(height). If newKey still falls between the
+// node's neighbours the key is rewritten in place and shape and colors stay
+// untouched; otherwise the node is removed and newKey inserted.
+bool RBTree::updateKey(int oldKey, int newKey) {
+    RBNode* n = find(oldKey);
+    if (!n) return false;
+    if (oldKey == newKey) return true;
+    if (find(newKey)) return false;  // keys are unique
+
+    RBNode* pred = predecessor(n);
+    RBNode* succ = successor(n);
+    if ((!pred || pred->key < newKey) && (!succ || newKey < succ->key)) {
+        n->key = newKey;
+        changes.record(TreeChange::Rekeyed, oldKey, newKey);
+        return true;
+    }
+
+    int v = n->value;
+    remove(oldKey);
+    insert(newKey, v);
+    return true;
+}
+
 void RBTree::transplant(RBNode* u, RBNode* v) {
     if (!u->parent) root = v;
     else if (u == u->parent->left) u->parent->left = v;
@@ -141,29 +257,30 @@ void RBTree::transplant(RBNode* u, RBNode* v) {
 
 void RBTree::deleteFixup(RBNode* x, RBNode* xParent) {
     while (x != root && (!x || !x->red)) {
+        TREE_STAT(visited);
         if (x == xParent->left) {
             RBNode* w = xParent->right;
             if (w && w->red) {
-                w->red = false;
-                xParent->red = true;
+                setRed(w, false);
+                setRed(xParent, true);
                 leftRotate(xParent);
                 w = xParent->right;
             }
             if (w && (!w->left || !w->left->red) && (!w->right || !w->right->red)) {
-                w->red = true;
+                setRed(w, true);
                 x = xParent;
                 xParent = x ? x->parent : nullptr;
             }
             else if (w) {
                 if (!w->right || !w->right->red) {
-                    if (w->left) w->left->red = false;
-                    w->red = true;
+                    if (w->left) setRed(w->left, false);
+                    setRed(w, true);
                     rightRotate(w);
                     w = xParent->right;
                 }
-                w->red = xParent->red;
-                xParent->red = false;
-                if (w->right) w->right->red = false;
+                setRed(w, xParent->red);
+                setRed(xParent, false);
+                if (w->right) setRed(w->right, false);
                 leftRotate(xParent);
                 x = root;
             }
@@ -171,38 +288,42 @@ void RBTree::deleteFixup(RBNode* x, RBNode* xParent) {
         else {
             RBNode* w = xParent->left;
             if (w && w->red) {
-                w->red = false;
-                xParent->red = true;
+                setRed(w, false);
+                setRed(xParent, true);
                 rightRotate(xParent);
                 w = xParent->left;
             }
             if (w && (!w->right || !w->right->red) && (!w->left || !w->left->red)) {
-                w->red = true;
+                setRed(w, true);
                 x = xParent;
                 xParent = x ? x->parent : nullptr;
             }
             else if (w) {
                 if (!w->left || !w->left->red) {
-                    if (w->right) w->right->red = false;
-                    w->red = true;
+                    if (w->right) setRed(w->right, false);
+                    setRed(w, true);
                     leftRotate(w);
                     w = xParent->left;
                 }
-                w->red = xParent->red;
-                xParent->red = false;
-                if (w->left) w->left->red = false;
+                setRed(w, xParent->red);
+                setRed(xParent, false);
+                if (w->left) setRed(w->left, false);
                 rightRotate(xParent);
                 x = root;
             }
         }
     }
-    if (x) x->red = false;
+    if (x) setRed(x, false);
 }
 
 bool RBTree::remove(int k) {
     RBNode* z = root;
-    while (z && z->key != k)
+    while (z) {
+        TREE_STAT(visited);
+        TREE_STAT(comparisons);
+        if (z->key == k) break;
         z = (k < z->key) ? z->left : z->right;
+    }
     if (!z) return false;
 
     RBNode* y = z;
@@ -210,6 +331,13 @@ bool RBTree::remove(int k) {
     RBNode* xParent;
     bool yOriginalRed = y->red;
 
+    // Lowest node whose subtree loses a node once z is unlinked
+    RBNode* changed = z->parent;
+    if (z->left && z->right) {
+        RBNode* succ = minimum(z->right);
+        changed = (succ->parent == z) ? succ : succ->parent;
+    }
+
     if (!z->left) {
         x = z->right;
         xParent = z->parent;
@@ -238,18 +366,460 @@ bool RBTree::remove(int k) {
         transplant(z, y);
         y->left = z->left;
         if (y->left) y->left->parent = y;
-        y->red = z->red;
+        setRed(y, z->red);
     }
-    delete z;
+    pool.destroy(z);
+    updateSizesUpward(changed);
+    changes.record(TreeChange::Removed, k);
     if (!yOriginalRed) deleteFixup(x, xParent);
     return true;
 }
 
+int RBTree::sizeOf(RBNode* n) {
+    return n ? n->size : 0;
+}
+
+void RBTree::updateSize(RBNode* n) {
+    n->size = 1 + sizeOf(n->left) + sizeOf(n->right);
+}
+
+void RBTree::updateSizesUpward(RBNode* n) {
+    for (; n; n = n->parent) {
+        TREE_STAT(visited);
+        updateSize(n);
+    }
+}
+
+int RBTree::size() {
+    return sizeOf(root);
+}
+
+// Number of keys strictly smaller than k.
+int RBTree::rank(int k) {
+    int r = 0;
+    RBNode* n = root;
+    while (n) {
+        if (k <= n->key) {
+            n = n->left;
+        }
+        else {
+            r += 1 + sizeOf(n->left);
+            n = n->right;
+        }
+    }
+    return r;
+}
+
+// The k-th smallest node (1-based), or nullptr if k is out of range.
+RBNode* RBTree::select(int k) {
+    RBNode* n = root;
+    while (n) {
+        int leftSize = sizeOf(n->left);
+        if (k <= leftSize) {
+            n = n->left;
+        }
+        else if (k == leftSize + 1) {
+            return n;
+        }
+        else {
+            k -= leftSize + 1;
+            n = n->right;
+        }
+    }
+    return nullptr;
+}
+
+// Inorder walk restricted to [lo, hi]: subtrees entirely below lo are
+// never entered and the walk stops at the first key above hi, so this is
+// O(height + number of results).
+std::vector<int> RBTree::rangeKeys(int lo, int hi) {
+    std::vector<int> out;
+    if (lo > hi) return out;
+    out.reserve(rangeCount(lo, hi));
+
+    std::vector<RBNode*> stack;
+    RBNode* n = root;
+    while (n || !stack.empty()) {
+        while (n) {
+            if (n->key < lo) {
+                n = n->right;
+            }
+            else {
+                stack.push_back(n);
+                n = n->left;
+            }
+        }
+        if (stack.empty()) break;
+        n = stack.back();
+        stack.pop_back();
+        if (n->key > hi) break;
+        out.push_back(n->key);
+        n = n->right;
+    }
+    return out;
+}
+
+// Number of keys in [lo, hi], from two rank queries.
+int RBTree::rangeCount(int lo, int hi) {
+    if (lo > hi) return 0;
+    int upTo = (hi == std::numeric_limits<int>::max()) ? size() : rank(hi + 1);
+    return upTo - rank(lo);
+}
+
+// Black nodes on the way from n down to a leaf, n included.
+int RBTree::blackHeight(RBNode* n) {
+    int h = 0;
+    for (; n; n = n->left)
+        if (!n->red) h++;
+    return h;
+}
+
+// Links l, k and r (keys in that order, black heights bl and br) into one
+// subtree with a black root and returns it, its black height in bh. Red
+// roots of l and r are blackened first. With unequal black heights, k goes
+// in red in place of the first black node down the taller side's inner
+// spine whose black height matches the other side, and insertFixup repairs
+// the path above, so the cost is O(|bl - br| + 1). Rotations at the top
+// point root at the result; callers set root once all pieces are joined.
+RBNode* RBTree::joinNodes(RBNode* l, int bl, RBNode* k, RBNode* r, int br, int& bh) {
+    if (l && l->red) {
+        setRed(l, false);
+        bl++;
+    }
+    if (r && r->red) {
+        setRed(r, false);
+        br++;
+    }
+    k->parent = nullptr;
+    if (bl == br) {
+        k->left = l;
+        k->right = r;
+        if (l) l->parent = k;
+        if (r) r->parent = k;
+        k->red = false;
+        updateSize(k);
+        bh = bl + 1;
+        return k;
+    }
+
+    bool intoLeft = bl > br;
+    RBNode* top = intoLeft ? l : r;
+    int target = intoLeft ? br : bl;
+    int h = intoLeft ? bl : br;     // black height of c
+    RBNode* p = nullptr;
+    RBNode* c = top;
+    while (c && (c->red || h > target)) {
+        TREE_STAT(visited);
+        if (!c->red) h--;
+        p = c;
+        c = intoLeft ? c->right : c->left;
+    }
+    if (intoLeft) {
+        k->left = c;
+        k->right = r;
+        p->right = k;
+    }
+    else {
+        k->left = l;
+        k->right = c;
+        p->left = k;
+    }
+    k->parent = p;
+    if (k->left) k->left->parent = k;
+    if (k->right) k->right->parent = k;
+    k->red = true;
+    updateSize(k);
+    updateSizesUpward(p);
+
+    root = top;
+    insertFixup(k);
+    bh = target;
+    for (RBNode* n = k; n; n = n->parent)
+        if (!n->red) bh++;
+    return root;
+}
+
+// Concatenates l and r, every key of l being below every key of r, by
+// splitting off l's largest node to join them with.
+RBNode* RBTree::join2(RBNode* l, int bl, RBNode* r, int br, int& bh) {
+    if (!l || !r) {
+        bh = l ? bl : br;
+        return l ? l : r;
+    }
+    RBNode* rest, * none;
+    int bRest, bNone;
+    RBNode* last = splitNodes(l, bl, maximum(l)->key, rest, bRest, none, bNone);
+    return joinNodes(rest, bRest, last, r, br, bh);
+}
+
+// Splits the subtree t (black height bh) around k into the keys below k (l)
+// and above it (r), with their black heights, and returns k's node, detached,
+// or nullptr if k is absent. Each level joins the part it keeps onto what the
+// level below returned; the black height differences of those joins
+// telescope, so the whole split is O(log n).
+RBNode* RBTree::splitNodes(RBNode* t, int bh, int k, RBNode*& l, int& bl, RBNode*& r, int& br) {
+    if (!t) {
+        l = r = nullptr;
+        bl = br = 0;
+        return nullptr;
+    }
+    TREE_STAT(visited);
+    TREE_STAT(comparisons);
+    int childBh = t->red ? bh : bh - 1;
+    RBNode* below = t->left;
+    RBNode* above = t->right;
+    if (below) below->parent = nullptr;
+    if (above) above->parent = nullptr;
+    t->left = t->right = t->parent = nullptr;
+
+    if (k == t->key) {
+        l = below;
+        r = above;
+        bl = br = childBh;
+        updateSize(t);
+        return t;
+    }
+    RBNode* found;
+    RBNode* mid;
+    int bMid;
+    if (k < t->key) {
+        found = splitNodes(below, childBh, k, l, bl, mid, bMid);
+        r = joinNodes(mid, bMid, t, above, childBh, br);
+    }
+    else {
+        found = splitNodes(above, childBh, k, mid, bMid, r, br);
+        l = joinNodes(below, childBh, t, mid, bMid, bl);
+    }
+    return found;
+}
+
+// Moves the keys below k into left and those above it into right, replacing
+// what they held; k itself is dropped. Either side may be this tree, which is
+// otherwise left empty. Returns whether k was present.
+bool RBTree::split(int k, RBTree& left, RBTree& right) {
+    RBNode* l, * r;
+    int bl, br;
+    RBNode* found = splitNodes(root, blackHeight(root), k, l, bl, r, br);
+    root = nullptr;
+    if (found) pool.destroy(found);
+
+    // One side takes over this pool (the larger one, unless this tree is
+    // one of them), the other shares its slabs
+    RBTree& keeper = &right == this || (&left != this && sizeOf(r) > sizeOf(l)) ? right : left;
+    RBTree& other = &keeper == &left ? right : left;
+    if (&keeper != this) {
+        keeper.clearTree();
+        keeper.pool.swap(pool);
+    }
+    if (&other != this) {
+        other.clearTree();
+        other.pool.share(keeper.pool);
+    }
+    if (&left != this && &right != this) clearTree();
+    left.root = l;
+    right.root = r;
+    for (RBTree* t : { &left, &right }) {
+        if (t->root) {
+            t->root->parent = nullptr;
+            t->root->red = false;
+        }
+        t->changes.reset();
+    }
+    return found != nullptr;
+}
+
+// Replaces this tree with left's keys, k and right's keys, leaving left and
+// right empty (either may be this tree). Fails without changing anything
+// unless every key of left is below k and every key of right above it.
+// O(log n): finding the black heights dominates the join itself.
+bool RBTree::join(RBTree& left, int k, RBTree& right) {
+    if ((left.root && maximum(left.root)->key >= k) || (right.root && minimum(right.root)->key <= k))
+        return false;
+    RBNode* l = left.root;
+    RBNode* r = right.root;
+    // Take over the larger side's pool unless this tree is one of the sides,
+    // and share the slabs of the rest
+    RBTree* donor = nullptr;
+    if (&left != this && &right != this) {
+        donor = sizeOf(r) > sizeOf(l) ? &right : &left;
+        clearTree();
+        pool.swap(donor->pool);
+    }
+    for (RBTree* t : { &left, &right }) {
+        if (t == this) continue;
+        if (t != donor) pool.share(t->pool);
+        t->clearTree();
+    }
+    RBNode* n = pool.create(k, k);
+    TREE_STAT(allocations);
+    int bh;
+    root = joinNodes(l, blackHeight(l), n, r, blackHeight(r), bh);
+    changes.reset();
+    return true;
+}
+
+// Deletes every key in [lo, hi] with two splits and one join: O(log n) plus
+// handing the removed nodes back to the pool. Returns how many there were.
+int RBTree::removeRange(int lo, int hi) {
+    if (lo > hi || !root) return 0;
+    RBNode* below, * rest, * middle, * above;
+    int bBelow, bRest, bMiddle, bAbove, bh;
+    RBNode* first = splitNodes(root, blackHeight(root), lo, below, bBelow, rest, bRest);
+    RBNode* last = splitNodes(rest, bRest, hi, middle, bMiddle, above, bAbove);
+    int removed = sizeOf(middle) + (first ? 1 : 0) + (last ? 1 : 0);
+    clear(middle);
+    if (first) pool.destroy(first);
+    if (last) pool.destroy(last);
+    root = join2(below, bBelow, above, bAbove, bh);
+    if (root) {
+        root->parent = nullptr;
+        root->red = false;
+    }
+    changes.reset();
+    return removed;
+}
+
+// One step of a set operation on the subtrees a (this side) and b (the
+// other side), with black heights ba and bb, run on the calling worker's
+// scratch tree from local: b is split around a's root, the halves below
+// and above are combined, in parallel when there is enough work, and
+// joined back with or without that root. The result's black height goes
+// to bh. Dropped nodes go to this (scratch) tree's pool.
+RBNode* RBTree::combine(RBNode* a, int ba, RBNode* b, int bb, SetOp op,
+                        const std::vector<std::unique_ptr<RBTree>>& local, int& bh) {
+    if (!a || !b) {
+        if (op == Union) {
+            bh = a ? ba : bb;
+            return a ? a : b;
+        }
+        clear(b);
+        if (op == Difference) {
+            bh = ba;
+            return a;
+        }
+        clear(a);
+        bh = 0;
+        return nullptr;
+    }
+    int work = sizeOf(a) + sizeOf(b);
+    int childBh = a->red ? ba : ba - 1;
+    RBNode* below = a->left;
+    RBNode* above = a->right;
+    if (below) below->parent = nullptr;
+    if (above) above->parent = nullptr;
+    a->left = a->right = nullptr;
+
+    RBNode* l, * r;
+    int bl, br;
+    RBNode* found = splitNodes(b, bb, a->key, l, bl, r, br);
+    RBNode* left, * right;
+    int bLeft, bRight;
+    if (work > parallelGrain && !local.empty()) {
+        WorkStealingPool& workers = WorkStealingPool::shared();
+        workers.invoke([&] { left = local[workers.slot()]->combine(below, childBh, l, bl, op, local, bLeft); },
+                       [&] { right = local[workers.slot()]->combine(above, childBh, r, br, op, local, bRight); });
+    }
+    else {
+        left = combine(below, childBh, l, bl, op, local, bLeft);
+        right = combine(above, childBh, r, br, op, local, bRight);
+    }
+
+    bool keep = op == Union || (op == Intersection) == (found != nullptr);
+    if (found) pool.destroy(found);
+    if (keep) return joinNodes(left, bLeft, a, right, bRight, bh);
+    pool.destroy(a);
+    return join2(left, bLeft, right, bRight, bh);
+}
+
+// Divide-and-conquer on split and join: O(m log(n/m + 1)) work for sizes
+// m <= n and O(log^2 n) span. Large inputs run on the shared work-stealing
+// pool, each worker joining on a scratch tree of its own so that rotations,
+// statistics and freed nodes never touch another thread's state; the
+// scratch trees hand their counters and freed nodes back afterwards.
+void RBTree::combineWith(RBTree& other, SetOp op) {
+    if (&other == this) {
+        if (op == Difference) clearTree();
+        return;
+    }
+    RBNode* a = root;
+    RBNode* b = other.root;
+    int ba = blackHeight(a);
+    int bb = blackHeight(b);
+    pool.share(other.pool);
+    pool.reclaim(other.pool);
+    other.clearTree();
+    root = nullptr;
+
+    std::vector<std::unique_ptr<RBTree>> local;
+    int bh;
+    if (sizeOf(a) + sizeOf(b) <= parallelGrain) {
+        root = combine(a, ba, b, bb, op, local, bh);
+    }
+    else {
+        WorkStealingPool& workers = WorkStealingPool::shared();
+        for (int i = 0; i < workers.size(); ++i) {
+            local.emplace_back(new RBTree);
+            local.back()->changes.setEnabled(false);
+        }
+        workers.run([&] { root = local[workers.slot()]->combine(a, ba, b, bb, op, local, bh); });
+        for (const std::unique_ptr<RBTree>& t : local) {
+            pool.reclaim(t->pool);
+            stats += t->stats;
+        }
+    }
+    if (root) {
+        root->parent = nullptr;
+        root->red = false;
+    }
+    changes.reset();
+}
+
+void RBTree::unionWith(RBTree& other) {
+    combineWith(other, Union);
+}
+
+void RBTree::intersectWith(RBTree& other) {
+    combineWith(other, Intersection);
+}
+
+void RBTree::differenceWith(RBTree& other) {
+    combineWith(other, Difference);
+}
+
+// The sorted batch is built into a balanced tree of its own in one pass and
+// unioned in, so a large batch costs one parallel merge instead of an
+// insert per key. Returns how many keys were new; keys is left sorted and
+// deduplicated, as it went in.
+int RBTree::insertBatch(std::vector<int>& keys) {
+    parallelSortUnique(keys);
+    int before = size();
+    RBTree batch;
+    batch.changes.setEnabled(false);
+    batch.buildFromSorted(keys);
+    stats += batch.stats;
+    unionWith(batch);
+    return size() - before;
+}
+
+// The traversals below walk parent pointers instead of recursing, so they
+// need no stack at all and stay safe on chain-shaped trees. Each one is
+// confined to the subtree rooted at n.
+
 void RBTree::inorder(RBNode* n, std::vector<int>& out) {
     if (!n) return;
-    inorder(n->left, out);
-    out.push_back(n->key);
-    inorder(n->right, out);
+    out.reserve(out.size() + n->size);
+    RBNode* cur = minimum(n);
+    while (cur) {
+        out.push_back(cur->key);
+        if (cur->right) {
+            cur = minimum(cur->right);
+            continue;
+        }
+        // Climb past every ancestor whose right side is already done
+        while (cur != n && cur == cur->parent->right)
+            cur = cur->parent;
+        cur = (cur == n) ? nullptr : cur->parent;
+    }
 }
 
 std::vector<int> RBTree::inorderKeys() {
@@ -260,9 +830,30 @@ std::vector<int> RBTree::inorderKeys() {
 
 void RBTree::preorder(RBNode* n, std::vector<int>& out) {
     if (!n) return;
-    out.push_back(n->key);
-    preorder(n->left, out);
-    preorder(n->right, out);
+    out.reserve(out.size() + n->size);
+    RBNode* cur = n;
+    while (cur) {
+        out.push_back(cur->key);
+        if (cur->left) {
+            cur = cur->left;
+        }
+        else if (cur->right) {
+            cur = cur->right;
+        }
+        else {
+            // Climb to the nearest ancestor with an unvisited right subtree
+            RBNode* next = nullptr;
+            while (cur != n) {
+                RBNode* p = cur->parent;
+                if (cur == p->left && p->right) {
+                    next = p->right;
+                    break;
+                }
+                cur = p;
+            }
+            cur = next;
+        }
+    }
 }
 
 std::vector<int> RBTree::preorderKeys() {
@@ -271,11 +862,26 @@ std::vector<int> RBTree::preorderKeys() {
     return v;
 }
 
+// First node of a postorder walk: the leaf reached by preferring left.
+static RBNode* firstPostorder(RBNode* n) {
+    while (n->left || n->right)
+        n = n->left ? n->left : n->right;
+    return n;
+}
+
 void RBTree::postorder(RBNode* n, std::vector<int>& out) {
     if (!n) return;
-    postorder(n->left, out);
-    postorder(n->right, out);
-    out.push_back(n->key);
+    out.reserve(out.size() + n->size);
+    RBNode* cur = firstPostorder(n);
+    while (true) {
+        out.push_back(cur->key);
+        if (cur == n) break;
+        RBNode* p = cur->parent;
+        if (cur == p->left && p->right)
+            cur = firstPostorder(p->right);
+        else
+            cur = p;
+    }
 }
 
 std::vector<int> RBTree::postorderKeys() {
@@ -284,9 +890,31 @@ std::vector<int> RBTree::postorderKeys() {
     return v;
 }
 
+// Preorder parent-pointer walk that tracks the current depth.
 int RBTree::getHeight(RBNode* n) {
     if (!n) return 0;
-    return 1 + std::max(getHeight(n->left), getHeight(n->right));
+    int depth = 1, best = 1;
+    RBNode* cur = n;
+    while (cur) {
+        best = std::max(best, depth);
+        if (cur->left || cur->right) {
+            cur = cur->left ? cur->left : cur->right;
+            depth++;
+            continue;
+        }
+        RBNode* next = nullptr;
+        while (cur != n) {
+            RBNode* p = cur->parent;
+            if (cur == p->left && p->right) {
+                next = p->right;
+                break;
+            }
+            cur = p;
+            depth--;
+        }
+        cur = next;
+    }
+    return best;
 }
 
 int RBTree::getWidth(RBNode* n) {
@@ -301,36 +929,125 @@ void RBTree::saveToFile(const std::string& filename) {
 }
 
 void RBTree::savePre(RBNode* n, std::ofstream& ofs) {
-    if (!n) {
-        ofs << "# ";
-        return;
+    // Null entries on the stack stand for the '#' sentinels
+    std::vector<RBNode*> stack;
+    stack.push_back(n);
+    while (!stack.empty()) {
+        RBNode* cur = stack.back();
+        stack.pop_back();
+        if (!cur) {
+            ofs << "# ";
+            continue;
+        }
+        ofs << cur->key << " ";
+        stack.push_back(cur->right);
+        stack.push_back(cur->left);
     }
-    ofs << n->key << " ";
-    savePre(n->left, ofs);
-    savePre(n->right, ofs);
 }
 
+// The text format carries no colors, so the keys are rebuilt into a
+// balanced tree with a fresh valid coloring. Use loadBinary to restore a
+// tree exactly as saved.
 void RBTree::loadFromFile(const std::string& filename) {
     std::ifstream ifs(filename);
     if (!ifs.is_open()) return;
-    clear(root);
-    root = loadPre(ifs, nullptr);
-    if (root) root->red = false;
+    std::vector<int> keys;
+    std::string tok;
+    while (ifs >> tok) {
+        if (tok == "#") continue;
+        keys.push_back(std::stoi(tok));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    buildFromSorted(keys);
 }
 
-RBNode* RBTree::loadPre(std::ifstream& ifs, RBNode* parent) {
-    std::string tok;
-    if (!(ifs >> tok)) return nullptr;
-    if (tok == "#") return nullptr;
-    int k = std::stoi(tok);
-    RBNode* n = new RBNode(k, k);
-    n->parent = parent;
-    n->left = loadPre(ifs, n);
-    n->right = loadPre(ifs, n);
-    return n;
+void RBTree::saveBinary(const std::string& filename) {
+    std::vector<char> buf;
+    std::uint64_t count = 0;
+    Snapshot::writeHeader(buf, Snapshot::KindRB, count);
+
+    std::vector<RBNode*> stack;
+    if (root) stack.push_back(root);
+    while (!stack.empty()) {
+        RBNode* n = stack.back();
+        stack.pop_back();
+        Snapshot::Record r = { n->key, n->value, 0 };
+        if (n->left) r.flags |= Snapshot::HasLeft;
+        if (n->right) r.flags |= Snapshot::HasRight;
+        if (n->red) r.flags |= Snapshot::Red;
+        Snapshot::appendRecord(buf, r);
+        count++;
+        if (n->right) stack.push_back(n->right);
+        if (n->left) stack.push_back(n->left);
+    }
+
+    Snapshot::writeHeader(buf, Snapshot::KindRB, count);
+    Snapshot::writeFile(filename, buf);
 }
 
+bool RBTree::loadBinary(const std::string& filename) {
+    std::vector<char> buf;
+    std::uint64_t count = 0;
+    if (!Snapshot::readFile(filename, buf) || !Snapshot::readHeader(buf, Snapshot::KindRB, count))
+        return false;
+    clearTree();
+
+    // Child links still waiting for their subtree, as (parent, isRight).
+    std::vector<std::pair<RBNode*, bool>> slots;
+    std::vector<RBNode*> nodes;
+    nodes.reserve(static_cast<std::size_t>(count));
+    slots.push_back({ nullptr, false });
+    for (std::uint64_t i = 0; i < count && !slots.empty(); ++i) {
+        std::pair<RBNode*, bool> slot = slots.back();
+        slots.pop_back();
+        Snapshot::Record r = Snapshot::recordAt(buf, i);
+        RBNode* n = pool.create(r.key, r.value);
+        TREE_STAT(allocations);
+        n->red = (r.flags & Snapshot::Red) != 0;
+        n->parent = slot.first;
+        if (!slot.first) root = n;
+        else if (slot.second) slot.first->right = n;
+        else slot.first->left = n;
+        if (r.flags & Snapshot::HasRight) slots.push_back({ n, true });
+        if (r.flags & Snapshot::HasLeft) slots.push_back({ n, false });
+        nodes.push_back(n);
+    }
+
+    // Preorder puts children after their parent: fill sizes bottom-up
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+        updateSize(*it);
+    return true;
+}
+
+// Bulk reset: every node goes back to the pool in O(1).
 void RBTree::clearTree() {
-    clear(root);
+    pool.reset();
     root = nullptr;
+    changes.reset();
+}
+
+// Replaces the tree with a perfectly balanced one holding keys, which must
+// be strictly increasing. Every leaf of the midpoint split sits on one of
+// the two deepest levels, so coloring the deepest level red and the rest
+// black gives every path the same black height.
+void RBTree::buildFromSorted(const std::vector<int>& keys) {
+    clearTree();
+    int n = static_cast<int>(keys.size());
+    int redDepth = 0;
+    while ((2 << redDepth) <= n) redDepth++;    // floor(log2(n))
+    root = buildBalanced(keys, 0, n - 1, nullptr, 0, redDepth);
+}
+
+RBNode* RBTree::buildBalanced(const std::vector<int>& keys, int lo, int hi, RBNode* parent, int depth, int redDepth) {
+    if (lo > hi) return nullptr;
+    int mid = lo + (hi - lo) / 2;
+    RBNode* n = pool.create(keys[mid], keys[mid]);
+    TREE_STAT(allocations);
+    n->parent = parent;
+    n->red = (depth == redDepth && depth > 0);
+    n->left = buildBalanced(keys, lo, mid - 1, n, depth + 1, redDepth);
+    n->right = buildBalanced(keys, mid + 1, hi, n, depth + 1, redDepth);
+    updateSize(n);
+    return n;
 }
\ No newline at end of file
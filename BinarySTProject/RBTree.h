@@ -1,12 +1,18 @@
 #ifndef RBTREE_H
 #define RBTREE_H
 
+#include <memory>
 #include <vector>
 #include <string>
+#include "NodePool.h"
+#include "Snapshot.h"
+#include "TreeChange.h"
+#include "TreeStats.h"
 
 class RBNode {
 public:
     int key, value;
+    int size;       // number of nodes in this subtree
     RBNode* left, * right, * parent;
     bool red;
     RBNode(int k = 0, int v = 0);
@@ -15,6 +21,9 @@ public:
 class RBTree {
 public:
     RBNode* root;
+    NodePool<RBNode> pool;
+    ChangeList changes;
+    TreeStats stats;
 
     RBTree();
     ~RBTree();
@@ -30,17 +39,69 @@ public:
 
     SearchResult search(int k);
 
+    // Outcome of a single-walk insert: the new node, or the existing one
+    // when the key was already present, and its depth after rebalancing.
+    struct InsertResult {
+        bool inserted;
+        RBNode* node;
+        int depth;
+        InsertResult();
+        InsertResult(bool i, RBNode* n, int d);
+    };
+
+    void setRed(RBNode* n, bool red);
     void leftRotate(RBNode* x);
     void rightRotate(RBNode* y);
 
+    InsertResult tryInsert(int k, int v);
     void insert(int k, int v);
+    int depthOf(RBNode* n);
     void insertFixup(RBNode* z);
 
     RBNode* minimum(RBNode* n);
+    RBNode* maximum(RBNode* n);
+    RBNode* find(int k);
+    RBNode* predecessor(RBNode* n);
+    RBNode* successor(RBNode* n);
+    bool updateKey(int oldKey, int newKey);
+
+    static int sizeOf(RBNode* n);
+    void updateSize(RBNode* n);
+    void updateSizesUpward(RBNode* n);
+
+    int size();
+    int rank(int k);
+    RBNode* select(int k);
+
+    std::vector<int> rangeKeys(int lo, int hi);
+    int rangeCount(int lo, int hi);
     void transplant(RBNode* u, RBNode* v);
     void deleteFixup(RBNode* x, RBNode* xParent);
     bool remove(int k);
 
+    // Join-based editing, by black height. Keys move between trees without
+    // being copied; the trees' pools share the slabs involved.
+    static int blackHeight(RBNode* n);
+    RBNode* joinNodes(RBNode* l, int bl, RBNode* k, RBNode* r, int br, int& bh);
+    RBNode* join2(RBNode* l, int bl, RBNode* r, int br, int& bh);
+    RBNode* splitNodes(RBNode* t, int bh, int k, RBNode*& l, int& bl, RBNode*& r, int& br);
+
+    bool split(int k, RBTree& left, RBTree& right);
+    bool join(RBTree& left, int k, RBTree& right);
+    int removeRange(int lo, int hi);
+
+    // Set operations with other, which ends up empty: its nodes are moved
+    // into this tree or freed, never copied.
+    enum SetOp { Union, Intersection, Difference };
+    RBNode* combine(RBNode* a, int ba, RBNode* b, int bb, SetOp op,
+                    const std::vector<std::unique_ptr<RBTree>>& local, int& bh);
+    void combineWith(RBTree& other, SetOp op);
+    void unionWith(RBTree& other);
+    void intersectWith(RBTree& other);
+    void differenceWith(RBTree& other);
+
+    int insertBatch(std::vector<int>& keys);
+
     void inorder(RBNode* n, std::vector<int>& out);
     std::vector<int> inorderKeys();
 
@@ -56,9 +117,14 @@ public:
     void saveToFile(const std::string& filename);
     void savePre(RBNode* n, std::ofstream& ofs);
     void loadFromFile(const std::string& filename);
-    RBNode* loadPre(std::ifstream& ifs, RBNode* parent);
+
+    void saveBinary(const std::string& filename);
+    bool loadBinary(const std::string& filename);
 
     void clearTree();
+
+    void buildFromSorted(const std::vector<int>& keys);
+    RBNode* buildBalanced(const std::vector<int>& keys, int lo, int hi, RBNode* parent, int depth, int redDepth);
 };
 
 #endif // RBTREE_H
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "Snapshot.h"
+#include <cstring>
+#include <fstream>
+
+namespace Snapshot {
+
+static const char Magic[4] = { 'B', 'S', 'T', 'S' };
+static const std::uint16_t Version = 1;
+
+void writeHeader(std::vector<char>& buf, Kind kind, std::uint64_t count) {
+    if (buf.size() < HeaderSize)
+        buf.resize(HeaderSize);
+    char* p = buf.data();
+    std::memcpy(p, Magic, 4);
+    std::memcpy(p + 4, &Version, 2);
+    p[6] = static_cast<char>(kind);
+    p[7] = 0;
+    std::memcpy(p + 8, &count, 8);
+}
+
+void appendRecord(std::vector<char>& buf, const Record& r) {
+    std::size_t at = buf.size();
+    buf.resize(at + RecordSize);
+    char* p = buf.data() + at;
+    std::memcpy(p, &r.key, 4);
+    std::memcpy(p + 4, &r.value, 4);
+    p[8] = static_cast<char>(r.flags);
+}
+
+bool readHeader(const std::vector<char>& buf, Kind kind, std::uint64_t& count) {
+    if (buf.size() < HeaderSize) return false;
+    const char* p = buf.data();
+    std::uint16_t version = 0;
+    std::memcpy(&version, p + 4, 2);
+    if (std::memcmp(p, Magic, 4) != 0 || version != Version) return false;
+    if (static_cast<std::uint8_t>(p[6]) != kind) return false;
+    std::memcpy(&count, p + 8, 8);
+    return (buf.size() - HeaderSize) / RecordSize >= count;
+}
+
+Record recordAt(const std::vector<char>& buf, std::uint64_t i) {
+    const char* p = buf.data() + HeaderSize + i * RecordSize;
+    Record r;
+    std::memcpy(&r.key, p, 4);
+    std::memcpy(&r.value, p + 4, 4);
+    r.flags = static_cast<std::uint8_t>(p[8]);
+    return r;
+}
+
+bool readFile(const std::string& filename, std::vector<char>& buf) {
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open()) return false;
+    std::streamsize size = ifs.tellg();
+    if (size < 0) return false;
+    buf.resize(static_cast<std::size_t>(size));
+    ifs.seekg(0);
+    return static_cast<bool>(ifs.read(buf.data(), size));
+}
+
+bool writeFile(const std::string& filename, const std::vector<char>& buf) {
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) return false;
+    ofs.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    return static_cast<bool>(ofs);
+}
+
+}
\ No newline at end of file
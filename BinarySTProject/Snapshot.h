@@ -0,0 +1,52 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compact binary tree snapshot shared by BST, AVL and RBTree.
+//
+// Layout (native little-endian):
+//   header  : "BSTS" magic, uint16 version, uint8 kind, uint8 reserved,
+//             uint64 node count
+//   records : one per node in preorder, int32 key, int32 value,
+//             uint8 flags (HasLeft, HasRight, Red)
+//
+// The child flags describe the exact shape, so a snapshot is rebuilt in a
+// single O(n) pass with no reinsertion and no rebalancing.
+namespace Snapshot {
+
+enum Kind : std::uint8_t {
+    KindBST = 0,
+    KindAVL = 1,
+    KindRB = 2
+};
+
+enum Flags : std::uint8_t {
+    HasLeft = 1,
+    HasRight = 2,
+    Red = 4
+};
+
+const std::size_t HeaderSize = 16;
+const std::size_t RecordSize = 9;
+
+struct Record {
+    std::int32_t key;
+    std::int32_t value;
+    std::uint8_t flags;
+};
+
+void writeHeader(std::vector<char>& buf, Kind kind, std::uint64_t count);
+void appendRecord(std::vector<char>& buf, const Record& r);
+bool readHeader(const std::vector<char>& buf, Kind kind, std::uint64_t& count);
+Record recordAt(const std::vector<char>& buf, std::uint64_t i);
+
+bool readFile(const std::string& filename, std::vector<char>& buf);
+bool writeFile(const std::string& filename, const std::vector<char>& buf);
+
+}
+
+#endif // SNAPSHOT_H
\ No newline at end of file
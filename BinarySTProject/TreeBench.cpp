@@ -0,0 +1,676 @@
+// Benchmark suite for BST, AVL and RBTree.
+//
+// For every size, workload and tree it measures insert, search, delete,
+// traversal, binary save and load, and reports throughput, p50/p99
+// latency and peak RSS as CSV or JSON. Workloads:
+//
+//   random, sorted, reverse   the tree is built in that key order, then
+//                             searched and emptied in random order
+//   zipf                      searches with Zipf-skewed popularity
+//   mixed                     80% search, 10% insert, 10% delete
+//   concurrent                AVL and RB only: one writer inserts n keys
+//                             into a persistent tree and publishes every
+//                             version while --readers threads search it
+//   setops                    AVL and RB only: union, intersection and
+//                             difference of two n-key trees sharing a
+//                             third of their keys
+//   batch                     n random keys added to an n-key tree one
+//                             insert at a time, then with one insertBatch
+//                             (reported as a single op of unit batch)
+//
+// Per-operation latency is sampled (at most --samples timed operations
+// per row) so timing does not distort the throughput. Whole-tree
+// operations (traverse, save, load) are timed per call and their
+// throughput counts nodes. Rows without sampled latencies (concurrent)
+// leave p50/p99 empty in CSV and null in JSON. Peak RSS is the process high-water mark; sizes
+// run smallest first so each row shows the peak up to that size.
+//
+// With --baseline, rows are compared against an earlier CSV and the exit
+// code is 2 when any throughput dropped by more than --tolerance.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BST.h"
+#include "AVL.h"
+#include "RBTree.h"
+#include "PublishedTree.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct Options {
+    std::vector<std::string> trees = { "bst", "avl", "rb" };
+    std::vector<std::string> workloads = { "random", "sorted", "reverse", "zipf", "mixed", "concurrent", "setops", "batch" };
+    std::vector<long long> sizes = { 1000, 10000, 100000, 1000000 };
+    std::vector<int> readers = { 1, 2, 4 };
+    std::string format = "csv";
+    std::string output;
+    std::string baseline;
+    double tolerance = 0.15;
+    double zipfExponent = 1.0;
+    long long samples = 100000;
+    long long maxDegenerate = 20000;
+    unsigned seed = 1;
+};
+
+struct Row {
+    std::string tree, workload, op, unit;
+    long long size, ops;
+    double seconds, p50, p99;    // p50/p99 are NaN when not sampled
+    long peakRssKb;
+
+    double perSecond() const { return seconds > 0 ? ops / seconds : 0; }
+};
+
+static void usage(const char* argv0)
+{
+    std::printf(
+        "Usage: %s [options]\n"
+        "  --trees bst,avl,rb                             trees to run (all)\n"
+        "  --workloads random,sorted,reverse,zipf,mixed,concurrent,setops,batch\n"
+        "                                                 workloads to run (all)\n"
+        "  --sizes 1k,10k,100k,1m                         tree sizes, k/m suffixes allowed; up to 10m\n"
+        "  --format csv|json                              output format (csv)\n"
+        "  --output PATH                                  write results there instead of stdout\n"
+        "  --baseline PATH                                earlier CSV to compare against\n"
+        "  --tolerance F                                  allowed throughput drop vs baseline (0.15)\n"
+        "  --zipf S                                       Zipf exponent (1.0)\n"
+        "  --samples N                                    timed operations per row (100000)\n"
+        "  --max-degenerate N                             largest BST built from sorted keys (20000)\n"
+        "  --readers 1,2,4                                reader threads for the concurrent workload\n"
+        "  --seed S                                       random seed (1)\n",
+        argv0);
+}
+
+static std::vector<std::string> splitList(const std::string& s)
+{
+    std::vector<std::string> out;
+    std::stringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+static long long parseSize(const std::string& s)
+{
+    char* end = nullptr;
+    double v = std::strtod(s.c_str(), &end);
+    if (end && (*end == 'k' || *end == 'K')) v *= 1e3;
+    else if (end && (*end == 'm' || *end == 'M')) v *= 1e6;
+    return (long long)v;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") return false;
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--trees") opt.trees = splitList(value);
+        else if (arg == "--workloads") opt.workloads = splitList(value);
+        else if (arg == "--sizes") {
+            opt.sizes.clear();
+            for (const std::string& s : splitList(value)) opt.sizes.push_back(parseSize(s));
+            std::sort(opt.sizes.begin(), opt.sizes.end());
+        }
+        else if (arg == "--format") opt.format = value;
+        else if (arg == "--output") opt.output = value;
+        else if (arg == "--baseline") opt.baseline = value;
+        else if (arg == "--tolerance") opt.tolerance = std::atof(value.c_str());
+        else if (arg == "--zipf") opt.zipfExponent = std::atof(value.c_str());
+        else if (arg == "--samples") opt.samples = std::max(1LL, std::atoll(value.c_str()));
+        else if (arg == "--max-degenerate") opt.maxDegenerate = std::atoll(value.c_str());
+        else if (arg == "--readers") {
+            opt.readers.clear();
+            for (const std::string& s : splitList(value)) opt.readers.push_back(std::max(1, std::atoi(s.c_str())));
+        }
+        else if (arg == "--seed") opt.seed = (unsigned)std::strtoul(value.c_str(), nullptr, 10);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    if (opt.format != "csv" && opt.format != "json") {
+        std::fprintf(stderr, "unknown format %s\n", opt.format.c_str());
+        return false;
+    }
+    return true;
+}
+
+static long peakRssKb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return (long)(pmc.PeakWorkingSetSize / 1024);
+#else
+    rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+    return (long)(ru.ru_maxrss / 1024);
+#else
+    return (long)ru.ru_maxrss;
+#endif
+#endif
+}
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Zipf(s) over 1..n by rejection-inversion (Hormann & Derflinger), so even
+// 10M keys need no CDF table.
+class ZipfSampler {
+public:
+    ZipfSampler(long long n, double s) : n(n), s(s) {
+        areaFirst = area(1.5) - 1;
+        areaAll = area(n + 0.5);
+        threshold = 2 - areaInverse(area(2.5) - weight(2));
+    }
+
+    template <typename Rng>
+    long long operator()(Rng& rng) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        for (;;) {
+            double u = areaAll + uniform(rng) * (areaFirst - areaAll);
+            double x = areaInverse(u);
+            long long k = (long long)(x + 0.5);
+            if (k < 1) k = 1;
+            else if (k > n) k = n;
+            if (k - x <= threshold || u >= area(k + 0.5) - weight((double)k))
+                return k;
+        }
+    }
+
+private:
+    long long n;
+    double s, areaFirst, areaAll, threshold;
+
+    // log(1 + x) / x and (exp(x) - 1) / x, accurate near 0
+    static double log1pOver(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+    }
+    static double expm1Over(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+    }
+    double weight(double x) const { return std::exp(-s * std::log(x)); }
+    // Integral of weight, up to a constant
+    double area(double x) const {
+        double logX = std::log(x);
+        return expm1Over((1 - s) * logX) * logX;
+    }
+    double areaInverse(double x) const {
+        double t = std::max(-1.0, x * (1 - s));
+        return std::exp(log1pOver(t) * x);
+    }
+};
+
+// Times every stride-th call so at most `limit` samples are taken
+class Sampler {
+public:
+    Sampler(long long ops, long long limit) : stride(std::max(1LL, (ops + limit - 1) / limit)), next(0) {
+        latencies.reserve((size_t)std::min(ops, limit) + 1);
+    }
+
+    template <typename F>
+    void run(F f) {
+        if (next++ % stride != 0) {
+            f();
+            return;
+        }
+        Clock::time_point start = Clock::now();
+        f();
+        latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+    }
+
+    double percentile(double p) {
+        if (latencies.empty()) return 0;
+        size_t i = std::min(latencies.size() - 1, (size_t)(p * latencies.size()));
+        std::nth_element(latencies.begin(), latencies.begin() + i, latencies.end());
+        return latencies[i];
+    }
+
+private:
+    long long stride, next;
+    std::vector<double> latencies;
+};
+
+class Bench {
+public:
+    Bench(const Options& opt) : opt(opt) {}
+
+    std::vector<Row> rows;
+
+    template <typename Tree>
+    void run(const std::string& tree, const std::string& workload, long long n);
+    template <typename Persistent>
+    void runConcurrent(const std::string& tree, long long n);
+    template <typename Tree>
+    void runSetOps(const std::string& tree, long long n);
+    template <typename Tree>
+    void runBatch(const std::string& tree, long long n);
+
+private:
+    const Options& opt;
+
+    // Runs body(sampler) over `ops` operations and records one row
+    template <typename Body>
+    void measure(const std::string& tree, const std::string& workload, long long n,
+                 const std::string& op, const std::string& unit, long long ops, long long timed, Body body) {
+        Sampler sampler(timed, opt.samples);
+        Clock::time_point start = Clock::now();
+        body(sampler);
+        double seconds = secondsSince(start);
+        Row r = { tree, workload, op, unit, n, ops, seconds,
+                  sampler.percentile(0.50), sampler.percentile(0.99), peakRssKb() };
+        rows.push_back(r);
+    }
+};
+
+// Keys are 0, 2, 4, ... so odd keys are guaranteed misses and fresh inserts
+template <typename Tree>
+void Bench::run(const std::string& name, const std::string& workload, long long n)
+{
+    std::mt19937_64 rng(opt.seed);
+    std::vector<int> keys((size_t)n);
+    for (long long i = 0; i < n; ++i) keys[(size_t)i] = (int)(2 * i);
+
+    std::vector<int> shuffled(keys);
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    Tree tree;
+    tree.changes.setEnabled(false);
+
+    if (workload == "zipf" || workload == "mixed") {
+        for (int k : shuffled) tree.insert(k, k);
+
+        if (workload == "zipf") {
+            // Popularity rank -> key, so hot keys are spread over the tree
+            ZipfSampler zipf(n, opt.zipfExponent);
+            std::vector<int> stream((size_t)n);
+            for (int& k : stream) k = shuffled[(size_t)(zipf(rng) - 1)];
+            long long found = 0;
+            measure(name, workload, n, "search", "op", n, n, [&](Sampler& s) {
+                for (int k : stream) s.run([&] { found += tree.search(k).found; });
+            });
+            if (found != n) std::fprintf(stderr, "%s zipf: %lld of %lld found\n", name.c_str(), found, n);
+            return;
+        }
+
+        // Inserts use odd keys and deletes pick from what is present, so
+        // the size stays around n
+        std::vector<std::pair<char, int>> stream((size_t)n);
+        std::vector<int> present(shuffled);
+        std::uniform_int_distribution<int> percent(0, 99);
+        long long nextOdd = 0;
+        for (auto& op : stream) {
+            int p = percent(rng);
+            std::uniform_int_distribution<size_t> pick(0, present.size() - 1);
+            if (p < 80 || present.empty()) {
+                op = { 's', present.empty() ? 0 : present[pick(rng)] };
+            }
+            else if (p < 90) {
+                int k = (int)(2 * (nextOdd++ % n) + 1);
+                op = { 'i', k };
+                present.push_back(k);
+            }
+            else {
+                size_t i = pick(rng);
+                op = { 'd', present[i] };
+                present[i] = present.back();
+                present.pop_back();
+            }
+        }
+        measure(name, workload, n, "mixed", "op", n, n, [&](Sampler& s) {
+            for (const auto& op : stream) {
+                if (op.first == 's') s.run([&] { tree.search(op.second); });
+                else if (op.first == 'i') s.run([&] { tree.insert(op.second, op.second); });
+                else s.run([&] { tree.remove(op.second); });
+            }
+        });
+        return;
+    }
+
+    const std::vector<int>* order = &shuffled;
+    std::vector<int> reversed;
+    if (workload == "sorted") {
+        order = &keys;
+    }
+    else if (workload == "reverse") {
+        reversed.assign(keys.rbegin(), keys.rend());
+        order = &reversed;
+    }
+
+    measure(name, workload, n, "insert", "op", n, n, [&](Sampler& s) {
+        for (int k : *order) s.run([&] { tree.insert(k, k); });
+    });
+
+    measure(name, workload, n, "search", "op", 2 * n, 2 * n, [&](Sampler& s) {
+        for (int k : shuffled) {
+            s.run([&] { tree.search(k); });
+            s.run([&] { tree.search(k + 1); });
+        }
+    });
+
+    // Whole-tree operations: enough calls for a stable number, counted in nodes
+    long long calls = std::max(1LL, std::min(20LL, 1000000 / std::max(1LL, n)));
+    measure(name, workload, n, "traverse", "node", 3 * n * calls, 3 * calls, [&](Sampler& s) {
+        for (long long c = 0; c < calls; ++c) {
+            s.run([&] { tree.inorderKeys(); });
+            s.run([&] { tree.preorderKeys(); });
+            s.run([&] { tree.postorderKeys(); });
+        }
+    });
+
+    std::string file = (std::filesystem::temp_directory_path() / "binaryst_bench.bin").string();
+    measure(name, workload, n, "save", "node", n * calls, calls, [&](Sampler& s) {
+        for (long long c = 0; c < calls; ++c) s.run([&] { tree.saveBinary(file); });
+    });
+    Tree loaded;
+    loaded.changes.setEnabled(false);
+    measure(name, workload, n, "load", "node", n * calls, calls, [&](Sampler& s) {
+        for (long long c = 0; c < calls; ++c) s.run([&] { loaded.loadBinary(file); });
+    });
+    if (loaded.size() != tree.size())
+        std::fprintf(stderr, "%s %s: loaded %d of %d nodes\n", name.c_str(), workload.c_str(), loaded.size(), tree.size());
+    std::remove(file.c_str());
+
+    measure(name, workload, n, "delete", "op", n, n, [&](Sampler& s) {
+        for (int k : shuffled) s.run([&] { tree.remove(k); });
+    });
+}
+
+// The tree starts with the n even keys; the writer then inserts the n odd
+// ones, publishing after each, while every reader searches random keys
+// until the writer is done. Each reader count gives a search row (reads of
+// all readers together) and an insert row (the writer alone), so the
+// search rows show how reads scale and the insert rows what they cost the
+// writer.
+template <typename Persistent>
+void Bench::runConcurrent(const std::string& name, long long n)
+{
+    std::mt19937_64 rng(opt.seed);
+    std::vector<int> keys((size_t)n);
+    for (long long i = 0; i < n; ++i) keys[(size_t)i] = (int)(2 * i);
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    for (int readers : opt.readers) {
+        Persistent versions;
+        VersionHistory history(versions, 1);    // only the head is needed
+        PublishedTree published(versions);
+        for (int k : keys) history.insert(k, k);
+        published.publish(history.current());
+
+        std::atomic<bool> stop(false);
+        std::vector<long long> reads((size_t)readers, 0);
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < readers; ++r) {
+            threads.emplace_back([&, r] {
+                PublishedTree::Reader reader(published);
+                std::mt19937_64 local(opt.seed + 1 + r);
+                std::uniform_int_distribution<long long> pick(0, 2 * n - 1);
+                long long count = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    reader.search((int)pick(local));
+                    ++count;
+                }
+                reads[(size_t)r] = count;
+            });
+        }
+
+        for (int k : keys) {
+            history.insert(k + 1, k + 1);
+            published.publish(history.current());
+        }
+        double writeSeconds = secondsSince(start);
+        stop.store(true);
+        for (std::thread& t : threads) t.join();
+        double seconds = secondsSince(start);
+
+        long long total = std::accumulate(reads.begin(), reads.end(), 0LL);
+        std::string suffix = "-r" + std::to_string(readers);
+        double none = std::numeric_limits<double>::quiet_NaN();
+        rows.push_back({ name, "concurrent", "search" + suffix, "op", n, total, seconds, none, none, peakRssKb() });
+        rows.push_back({ name, "concurrent", "insert" + suffix, "op", n, n, writeSeconds, none, none, peakRssKb() });
+    }
+}
+
+// A holds 0, 2, 4, ... and B 0, 3, 6, ..., n keys each. The input trees
+// for every call are built up front, so only the operations are timed;
+// throughput counts the nodes of both inputs, like the whole-tree rows.
+template <typename Tree>
+void Bench::runSetOps(const std::string& name, long long n)
+{
+    std::vector<int> evens((size_t)n), triples((size_t)n);
+    for (long long i = 0; i < n; ++i) {
+        evens[(size_t)i] = (int)(2 * i);
+        triples[(size_t)i] = (int)(3 * i);
+    }
+    // Multiples of 6 are the shared keys
+    long long shared = n > 0 ? (2 * n - 2) / 6 + 1 : 0;
+
+    const char* ops[] = { "union", "intersect", "difference" };
+    for (const char* op : ops) {
+        std::string opName = op;
+        long long calls = std::max(1LL, std::min(20LL, 1000000 / std::max(1LL, n)));
+        std::vector<std::unique_ptr<Tree>> as, bs;
+        for (long long c = 0; c < calls; ++c) {
+            as.emplace_back(new Tree);
+            bs.emplace_back(new Tree);
+            as.back()->changes.setEnabled(false);
+            bs.back()->changes.setEnabled(false);
+            as.back()->buildFromSorted(evens);
+            bs.back()->buildFromSorted(triples);
+        }
+        measure(name, "setops", n, opName, "node", 2 * n * calls, calls, [&](Sampler& s) {
+            for (long long c = 0; c < calls; ++c) {
+                Tree& a = *as[(size_t)c];
+                Tree& b = *bs[(size_t)c];
+                s.run([&] {
+                    if (opName == "union") a.unionWith(b);
+                    else if (opName == "intersect") a.intersectWith(b);
+                    else a.differenceWith(b);
+                });
+            }
+        });
+        long long expected = opName == "union" ? 2 * n - shared : opName == "intersect" ? shared : n - shared;
+        if (as[0]->size() != expected)
+            std::fprintf(stderr, "%s setops %s: %d keys, expected %lld\n", name.c_str(), op, as[0]->size(), expected);
+    }
+}
+
+// Both trees start with the n even keys; the batch draws n keys from
+// [0, 4n), so about a quarter of it is already present.
+template <typename Tree>
+void Bench::runBatch(const std::string& name, long long n)
+{
+    std::mt19937_64 rng(opt.seed);
+    std::vector<int> evens((size_t)n);
+    for (long long i = 0; i < n; ++i) evens[(size_t)i] = (int)(2 * i);
+    std::uniform_int_distribution<long long> pick(0, std::max(0LL, 4 * n - 1));
+    std::vector<int> batch((size_t)n);
+    for (int& k : batch) k = (int)pick(rng);
+
+    Tree looped, batched;
+    looped.changes.setEnabled(false);
+    batched.changes.setEnabled(false);
+    looped.buildFromSorted(evens);
+    batched.buildFromSorted(evens);
+
+    measure(name, "batch", n, "insert-loop", "op", n, n, [&](Sampler& s) {
+        for (int k : batch) s.run([&] { looped.insert(k, k); });
+    });
+    measure(name, "batch", n, "insert-batch", "batch", 1, 1, [&](Sampler& s) {
+        s.run([&] { batched.insertBatch(batch); });
+    });
+    if (looped.size() != batched.size())
+        std::fprintf(stderr, "%s batch: %d keys after the batch, %d after the loop\n", name.c_str(), batched.size(), looped.size());
+}
+
+// A latency in whole nanoseconds, or `none` when it was not sampled
+static std::string latency(double ns, const char* none)
+{
+    if (std::isnan(ns)) return none;
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%.0f", ns);
+    return buf;
+}
+
+static void writeCsv(std::FILE* out, const std::vector<Row>& rows)
+{
+    std::fprintf(out, "tree,workload,size,op,unit,ops,seconds,ops_per_sec,p50_ns,p99_ns,peak_rss_kb\n");
+    for (const Row& r : rows) {
+        std::fprintf(out, "%s,%s,%lld,%s,%s,%lld,%.6f,%.0f,%s,%s,%ld\n",
+            r.tree.c_str(), r.workload.c_str(), r.size, r.op.c_str(), r.unit.c_str(),
+            r.ops, r.seconds, r.perSecond(), latency(r.p50, "").c_str(), latency(r.p99, "").c_str(), r.peakRssKb);
+    }
+}
+
+static void writeJson(std::FILE* out, const std::vector<Row>& rows)
+{
+    std::fprintf(out, "[\n");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Row& r = rows[i];
+        std::fprintf(out,
+            "  {\"tree\": \"%s\", \"workload\": \"%s\", \"size\": %lld, \"op\": \"%s\", \"unit\": \"%s\", "
+            "\"ops\": %lld, \"seconds\": %.6f, \"ops_per_sec\": %.0f, \"p50_ns\": %s, \"p99_ns\": %s, "
+            "\"peak_rss_kb\": %ld}%s\n",
+            r.tree.c_str(), r.workload.c_str(), r.size, r.op.c_str(), r.unit.c_str(),
+            r.ops, r.seconds, r.perSecond(), latency(r.p50, "null").c_str(), latency(r.p99, "null").c_str(), r.peakRssKb,
+            i + 1 < rows.size() ? "," : "");
+    }
+    std::fprintf(out, "]\n");
+}
+
+// Returns how many rows fell below the baseline's throughput by more than
+// the tolerance. Rows missing from either side are ignored.
+static int compareBaseline(const Options& opt, const std::vector<Row>& rows)
+{
+    std::ifstream in(opt.baseline);
+    if (!in) {
+        std::fprintf(stderr, "cannot open baseline %s\n", opt.baseline.c_str());
+        return 0;
+    }
+    std::map<std::string, double> before;
+    std::string line;
+    std::getline(in, line);   // header
+    while (std::getline(in, line)) {
+        std::vector<std::string> f = splitList(line);
+        if (f.size() < 8) continue;
+        before[f[0] + "," + f[1] + "," + f[2] + "," + f[3]] = std::atof(f[7].c_str());
+    }
+
+    int regressions = 0;
+    for (const Row& r : rows) {
+        auto it = before.find(r.tree + "," + r.workload + "," + std::to_string(r.size) + "," + r.op);
+        if (it == before.end() || it->second <= 0) continue;
+        double ratio = r.perSecond() / it->second;
+        if (ratio < 1 - opt.tolerance) {
+            std::fprintf(stderr, "regression: %s %s %lld %s %.0f -> %.0f ops/s (%.0f%%)\n",
+                r.tree.c_str(), r.workload.c_str(), r.size, r.op.c_str(),
+                it->second, r.perSecond(), (ratio - 1) * 100);
+            ++regressions;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Bench bench(opt);
+    for (long long n : opt.sizes) {
+        if (n <= 0 || n > 100000000) {
+            std::fprintf(stderr, "skipping size %lld\n", n);
+            continue;
+        }
+        for (const std::string& workload : opt.workloads) {
+            for (const std::string& tree : opt.trees) {
+                // A plain BST built from sorted keys is a list: O(n^2) to build
+                if (tree == "bst" && (workload == "sorted" || workload == "reverse") && n > opt.maxDegenerate) {
+                    std::fprintf(stderr, "skipping bst %s %lld (above --max-degenerate)\n", workload.c_str(), n);
+                    continue;
+                }
+                if (workload == "concurrent" && tree == "bst") {
+                    std::fprintf(stderr, "skipping bst concurrent (no persistent BST)\n");
+                    continue;
+                }
+                if (workload == "setops" && tree == "bst") {
+                    std::fprintf(stderr, "skipping bst setops (no join-based BST)\n");
+                    continue;
+                }
+                std::fprintf(stderr, "%s %s %lld\n", tree.c_str(), workload.c_str(), n);
+                if (workload == "concurrent") {
+                    if (tree == "avl") bench.runConcurrent<PersistentAVL>(tree, n);
+                    else if (tree == "rb") bench.runConcurrent<PersistentRB>(tree, n);
+                    else std::fprintf(stderr, "unknown tree %s\n", tree.c_str());
+                }
+                else if (workload == "batch") {
+                    if (tree == "bst") bench.runBatch<BST>(tree, n);
+                    else if (tree == "avl") bench.runBatch<AVL>(tree, n);
+                    else if (tree == "rb") bench.runBatch<RBTree>(tree, n);
+                    else std::fprintf(stderr, "unknown tree %s\n", tree.c_str());
+                }
+                else if (workload == "setops") {
+                    if (tree == "avl") bench.runSetOps<AVL>(tree, n);
+                    else if (tree == "rb") bench.runSetOps<RBTree>(tree, n);
+                    else std::fprintf(stderr, "unknown tree %s\n", tree.c_str());
+                }
+                else if (tree == "bst") bench.run<BST>(tree, workload, n);
+                else if (tree == "avl") bench.run<AVL>(tree, workload, n);
+                else if (tree == "rb") bench.run<RBTree>(tree, workload, n);
+                else std::fprintf(stderr, "unknown tree %s\n", tree.c_str());
+            }
+        }
+    }
+
+    std::FILE* out = stdout;
+    if (!opt.output.empty()) {
+        out = std::fopen(opt.output.c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "cannot write %s\n", opt.output.c_str());
+            return 1;
+        }
+    }
+    if (opt.format == "json") writeJson(out, bench.rows);
+    else writeCsv(out, bench.rows);
+    if (out != stdout) std::fclose(out);
+
+    if (!opt.baseline.empty() && compareBaseline(opt, bench.rows) > 0) return 2;
+    return 0;
+}
\ No newline at end of file
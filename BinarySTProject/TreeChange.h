@@ -0,0 +1,54 @@
+#ifndef TREECHANGE_H
+#define TREECHANGE_H
+
+#include <vector>
+
+// One structural change made by a tree operation. Nodes are named by key,
+// since node addresses mean nothing outside the tree.
+struct TreeChange {
+    enum Kind : unsigned char {
+        Created = 0,    // key: the new node
+        Removed = 1,    // key: the removed key
+        Rotated = 2,    // key: node that moved down, other: node that moved up
+        Recolored = 3,  // key: the node, other: 1 if it is now red, 0 if black
+        Rekeyed = 4,    // key: old key, other: new key; the shape is unchanged
+        Reset = 5       // the whole tree was replaced (clear, load, bulk build)
+    };
+    Kind kind;
+    int key;
+    int other;
+};
+
+// Changes recorded since the last take(). After a Reset nothing else is
+// kept, so bulk rebuilds do not grow the list. Owners that never look at
+// the changes (benchmarks, the CLI) switch recording off.
+class ChangeList {
+public:
+    ChangeList() : enabled(true) {}
+
+    void setEnabled(bool on) {
+        enabled = on;
+        if (!on) changes.clear();
+    }
+    void record(TreeChange::Kind kind, int key, int other = 0) {
+        if (!enabled) return;
+        if (!changes.empty() && changes.front().kind == TreeChange::Reset) return;
+        changes.push_back({ kind, key, other });
+    }
+    void reset() {
+        if (!enabled) return;
+        changes.clear();
+        changes.push_back({ TreeChange::Reset, 0, 0 });
+    }
+    std::vector<TreeChange> take() {
+        std::vector<TreeChange> out;
+        out.swap(changes);
+        return out;
+    }
+
+private:
+    std::vector<TreeChange> changes;
+    bool enabled;
+};
+
+#endif // TREECHANGE_H
\ No newline at end of file
@@ -0,0 +1,225 @@
+// Headless driver for the tree engine: runs insert, search, traversal and
+// delete workloads against BST, AVL and RBTree and prints the throughput.
+// Links only BinarySTCore, so it runs on machines without Qt or a display.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "BST.h"
+#include "AVL.h"
+#include "RBTree.h"
+
+struct Options {
+    std::string tree = "all";
+    std::string workload = "all";
+    std::string generator = "random";
+    std::string file;
+    int count = 100000;
+    int repeat = 1;
+    unsigned seed = 1;
+};
+
+static void usage(const char* argv0)
+{
+    std::printf(
+        "Usage: %s [options]\n"
+        "  --tree bst|avl|rb|all                          trees to run (all)\n"
+        "  --workload insert|search|traverse|delete|all   workloads to run (all)\n"
+        "  --gen random|sequential|reverse                key generator (random)\n"
+        "  --count N                                      number of keys (100000)\n"
+        "  --seed S                                       random seed (1)\n"
+        "  --file PATH                                    read whitespace-separated keys instead\n"
+        "  --repeat R                                     runs per workload, best is reported (1)\n",
+        argv0);
+}
+
+static bool parseOptions(int argc, char* argv[], Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") return false;
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--tree") opt.tree = value;
+        else if (arg == "--workload") opt.workload = value;
+        else if (arg == "--gen") opt.generator = value;
+        else if (arg == "--file") opt.file = value;
+        else if (arg == "--count") opt.count = std::atoi(value);
+        else if (arg == "--repeat") opt.repeat = std::max(1, std::atoi(value));
+        else if (arg == "--seed") opt.seed = (unsigned)std::strtoul(value, nullptr, 10);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keys are made unique, since the trees reject duplicates anyway and a
+// repeated key would make insert and delete counts disagree.
+static bool loadKeys(const Options& opt, std::vector<int>& keys)
+{
+    if (!opt.file.empty()) {
+        std::ifstream in(opt.file);
+        if (!in) {
+            std::fprintf(stderr, "cannot open %s\n", opt.file.c_str());
+            return false;
+        }
+        std::unordered_set<int> seen;
+        int k;
+        while (in >> k) {
+            if (seen.insert(k).second) keys.push_back(k);
+        }
+        return true;
+    }
+
+    keys.resize(std::max(0, opt.count));
+    std::iota(keys.begin(), keys.end(), 0);
+    if (opt.generator == "reverse") {
+        std::reverse(keys.begin(), keys.end());
+    }
+    else if (opt.generator == "random") {
+        std::mt19937 rng(opt.seed);
+        std::shuffle(keys.begin(), keys.end(), rng);
+    }
+    else if (opt.generator != "sequential") {
+        std::fprintf(stderr, "unknown generator %s\n", opt.generator.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct Timer {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+static void report(const char* tree, const char* workload, long long ops, double seconds, long long check)
+{
+    double perSecond = seconds > 0 ? ops / seconds : 0;
+    double nsPerOp = ops > 0 ? seconds * 1e9 / ops : 0;
+    std::printf("%-4s %-9s %10lld ops %10.3f ms %14.0f ops/s %10.1f ns/op  (check %lld)\n",
+        tree, workload, ops, seconds * 1e3, perSecond, nsPerOp, check);
+}
+
+static bool wants(const std::string& selected, const char* name)
+{
+    return selected == "all" || selected == name;
+}
+
+// One tree type through every selected workload. Each repetition starts
+// from a fresh tree; the fastest run is reported. The check column is a
+// result the optimizer cannot drop (nodes found, visited or removed).
+template <typename Tree>
+static void run(const char* name, const Options& opt, const std::vector<int>& keys)
+{
+    std::vector<int> order(keys);
+    std::mt19937 rng(opt.seed + 1);
+    std::shuffle(order.begin(), order.end(), rng);
+    long long n = (long long)keys.size();
+
+    auto fill = [&](Tree& tree) {
+        for (int k : keys) tree.insert(k, k);
+    };
+
+    if (wants(opt.workload, "insert")) {
+        double best = 0;
+        long long size = 0;
+        for (int r = 0; r < opt.repeat; ++r) {
+            Tree tree;
+            tree.changes.setEnabled(false);
+            Timer t;
+            fill(tree);
+            double s = t.seconds();
+            if (r == 0 || s < best) best = s;
+            size = tree.size();
+        }
+        report(name, "insert", n, best, size);
+    }
+
+    Tree tree;
+    tree.changes.setEnabled(false);
+    bool needTree = wants(opt.workload, "search") || wants(opt.workload, "traverse")
+        || wants(opt.workload, "delete");
+    if (needTree) fill(tree);
+
+    if (wants(opt.workload, "search")) {
+        double best = 0;
+        long long found = 0;
+        for (int r = 0; r < opt.repeat; ++r) {
+            found = 0;
+            Timer t;
+            for (int k : order) found += tree.search(k).found;
+            // Misses walk to a leaf, so they are measured too
+            for (int k : order) found += tree.search(-k - 1).found;
+            double s = t.seconds();
+            if (r == 0 || s < best) best = s;
+        }
+        report(name, "search", 2 * n, best, found);
+    }
+
+    if (wants(opt.workload, "traverse")) {
+        double best = 0;
+        long long visited = 0;
+        for (int r = 0; r < opt.repeat; ++r) {
+            visited = 0;
+            Timer t;
+            visited += (long long)tree.inorderKeys().size();
+            visited += (long long)tree.preorderKeys().size();
+            visited += (long long)tree.postorderKeys().size();
+            double s = t.seconds();
+            if (r == 0 || s < best) best = s;
+        }
+        report(name, "traverse", 3 * n, best, visited);
+    }
+
+    if (wants(opt.workload, "delete")) {
+        double best = 0;
+        long long removed = 0;
+        for (int r = 0; r < opt.repeat; ++r) {
+            if (r > 0) fill(tree);
+            removed = 0;
+            Timer t;
+            for (int k : order) removed += tree.remove(k);
+            double s = t.seconds();
+            if (r == 0 || s < best) best = s;
+        }
+        report(name, "delete", n, best, removed);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (opt.tree != "all" && opt.tree != "bst" && opt.tree != "avl" && opt.tree != "rb") {
+        std::fprintf(stderr, "unknown tree %s\n", opt.tree.c_str());
+        return 1;
+    }
+
+    std::vector<int> keys;
+    if (!loadKeys(opt, keys)) return 1;
+    std::printf("%zu keys (%s), %d repetition(s)\n", keys.size(),
+        opt.file.empty() ? opt.generator.c_str() : opt.file.c_str(), opt.repeat);
+
+    if (wants(opt.tree, "bst")) run<BST>("bst", opt, keys);
+    if (wants(opt.tree, "avl")) run<AVL>("avl", opt, keys);
+    if (wants(opt.tree, "rb")) run<RBTree>("rb", opt, keys);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include "TreeLayout.h"
+#include <algorithm>
+#include <cmath>
+
+static bool isRed(const BSTNode*) { return false; }
+static bool isRed(const RBNode* n) { return n->red; }
+static bool isRed(const VersionNode* n) { return n->red; }
+
+TreeLayout::TreeLayout(double siblingSeparation, double levelSeparation)
+    : siblingSeparation(siblingSeparation), levelSeparation(levelSeparation), width(0), height(0), depthTotal(0) {
+}
+
+void TreeLayout::clear() {
+    keys.clear();
+    parent.clear();
+    left.clear();
+    right.clear();
+    level.clear();
+    red.clear();
+    x.clear();
+    y.clear();
+    subtreeSize.clear();
+    subtreeHeight.clear();
+    subtreeMinX.clear();
+    subtreeMaxX.clear();
+    minKey.clear();
+    maxKey.clear();
+    byKey.clear();
+    rows.clear();
+    rowSpan.clear();
+    width = 0;
+    height = 0;
+    depthTotal = 0;
+}
+
+void TreeLayout::build(BSTNode* root) {
+    collect(root);
+    place();
+}
+
+void TreeLayout::build(RBNode* root) {
+    collect(root);
+    place();
+}
+
+void TreeLayout::build(const VersionNode* root) {
+    collect(root);
+    place();
+}
+
+// Flattens the tree into preorder arrays with an explicit stack.
+template <typename Node>
+void TreeLayout::collect(Node* root) {
+    clear();
+    struct Frame { Node* node; int parent; bool isLeft; };
+    std::vector<Frame> stack;
+    if (root) stack.push_back({ root, -1, false });
+
+    while (!stack.empty()) {
+        Frame f = stack.back();
+        stack.pop_back();
+
+        int i = count();
+        keys.push_back(f.node->key);
+        parent.push_back(f.parent);
+        left.push_back(-1);
+        right.push_back(-1);
+        level.push_back(f.parent < 0 ? 0 : level[f.parent] + 1);
+        red.push_back(isRed(f.node));
+        subtreeSize.push_back(f.node->size);
+        if (f.parent >= 0) {
+            if (f.isLeft) left[f.parent] = i;
+            else right[f.parent] = i;
+        }
+
+        if (f.node->right) stack.push_back({ f.node->right, i, false });
+        if (f.node->left) stack.push_back({ f.node->left, i, true });
+    }
+}
+
+// Reingold-Tilford. Walking the preorder arrays backwards visits every
+// subtree before its root. For each subtree we keep its height, its
+// horizontal extent and the extreme nodes of its lowest level (relative to
+// the subtree root). When a subtree is shallower than its sibling, its
+// extreme node is threaded to the sibling's next contour node, so later
+// contour walks never descend into the interior of a subtree. Each walk
+// costs the height of the shallower child, which sums to O(n).
+//
+// On top of plain Reingold-Tilford, a left subtree is kept entirely left of
+// its root and a right subtree entirely right of it, so x follows the
+// in-order (key) order of a search tree.
+void TreeLayout::place() {
+    int n = count();
+    x.assign(n, 0);
+    y.assign(n, 0);
+    width = 0;
+    height = 0;
+    depthTotal = 0;
+    if (n == 0) return;
+
+    double minSep = siblingSeparation;
+    double orderGap = minSep / 2; // min x distance between a node and its opposite-side descendants
+
+    std::vector<double> rel(n, 0);          // x offset from the parent
+    std::vector<double> minX(n, 0), maxX(n, 0);
+    std::vector<int> subHeight(n, 0);
+    std::vector<int> extLeft(n), extRight(n);
+    std::vector<double> offLeft(n, 0), offRight(n, 0);
+    std::vector<int> thread(n, -1);
+    std::vector<double> threadRel(n, 0);
+
+    // Next node on the left / right contour and its x relative to v
+    auto nextLeft = [&](int v, double& dx) {
+        int c = left[v] >= 0 ? left[v] : right[v];
+        if (c >= 0) { dx = rel[c]; return c; }
+        dx = threadRel[v];
+        return thread[v];
+    };
+    auto nextRight = [&](int v, double& dx) {
+        int c = right[v] >= 0 ? right[v] : left[v];
+        if (c >= 0) { dx = rel[c]; return c; }
+        dx = threadRel[v];
+        return thread[v];
+    };
+
+    for (int v = n - 1; v >= 0; --v) {
+        int l = left[v], r = right[v];
+        extLeft[v] = extRight[v] = v;
+
+        if (l < 0 && r < 0) continue;
+
+        if (r < 0) {
+            double d = std::max(minSep / 2, maxX[l] + orderGap);
+            rel[l] = -d;
+            subHeight[v] = subHeight[l] + 1;
+            extLeft[v] = extLeft[l];
+            extRight[v] = extRight[l];
+            offLeft[v] = offLeft[l] - d;
+            offRight[v] = offRight[l] - d;
+            minX[v] = std::min(0.0, minX[l] - d);
+            maxX[v] = std::max(0.0, maxX[l] - d);
+            continue;
+        }
+        if (l < 0) {
+            double d = std::max(minSep / 2, orderGap - minX[r]);
+            rel[r] = d;
+            subHeight[v] = subHeight[r] + 1;
+            extLeft[v] = extLeft[r];
+            extRight[v] = extRight[r];
+            offLeft[v] = offLeft[r] + d;
+            offRight[v] = offRight[r] + d;
+            minX[v] = std::min(0.0, minX[r] + d);
+            maxX[v] = std::max(0.0, maxX[r] + d);
+            continue;
+        }
+
+        // Walk the right contour of l and the left contour of r together
+        // and find the root distance that keeps them minSep apart.
+        int lc = l, rc = r;
+        double lx = 0, rx = 0, sep = minSep;
+        int nl, nr;
+        double dl = 0, dr = 0;
+        while (true) {
+            sep = std::max(sep, lx - rx + minSep);
+            nl = nextRight(lc, dl);
+            nr = nextLeft(rc, dr);
+            if (nl < 0 || nr < 0) break;
+            lc = nl; lx += dl;
+            rc = nr; rx += dr;
+        }
+
+        // Center the root over its children unless one side has to move
+        // further out to stay clear of the root's own column.
+        double toLeft = std::max(sep / 2, maxX[l] + orderGap);
+        double toRight = std::max(sep - toLeft, orderGap - minX[r]);
+        toLeft = std::max(sep - toRight, maxX[l] + orderGap);
+        rel[l] = -toLeft;
+        rel[r] = toRight;
+
+        // Thread the shallower side onto the deeper side's contour
+        if (nl < 0 && nr >= 0) {
+            int e = extLeft[l];
+            thread[e] = nr;
+            threadRel[e] = (toRight + rx + dr) - (offLeft[l] - toLeft);
+        }
+        else if (nr < 0 && nl >= 0) {
+            int e = extRight[r];
+            thread[e] = nl;
+            threadRel[e] = (lx + dl - toLeft) - (offRight[r] + toRight);
+        }
+
+        subHeight[v] = std::max(subHeight[l], subHeight[r]) + 1;
+        if (subHeight[l] >= subHeight[r]) {
+            extLeft[v] = extLeft[l];
+            offLeft[v] = offLeft[l] - toLeft;
+        }
+        else {
+            extLeft[v] = extLeft[r];
+            offLeft[v] = offLeft[r] + toRight;
+        }
+        if (subHeight[r] >= subHeight[l]) {
+            extRight[v] = extRight[r];
+            offRight[v] = offRight[r] + toRight;
+        }
+        else {
+            extRight[v] = extRight[l];
+            offRight[v] = offRight[l] - toLeft;
+        }
+        minX[v] = std::min(minX[l] - toLeft, minX[r] + toRight);
+        maxX[v] = std::max(maxX[l] - toLeft, maxX[r] + toRight);
+    }
+
+    // Parents come before children in preorder, so one forward pass turns
+    // offsets into absolute positions.
+    // Preorder also meets the nodes of a level from left to right, so the
+    // rows come out sorted by x.
+    rows.clear();
+    rowSpan.clear();
+    for (int v = 0; v < n; ++v) {
+        x[v] = parent[v] < 0 ? -minX[0] : x[parent[v]] + rel[v];
+        y[v] = level[v] * levelSeparation;
+        if (level[v] >= (int)rows.size()) {
+            rows.emplace_back();
+            rowSpan.push_back(0);
+        }
+        rows[level[v]].push_back(v);
+        rowSpan[level[v]] = std::max(rowSpan[level[v]], std::abs(rel[v]));
+        depthTotal += level[v];
+    }
+    width = maxX[0] - minX[0];
+    height = (rows.size() - 1) * levelSeparation;
+
+    // Subtree summaries. In a search tree the smallest key of a subtree is
+    // at the end of its left spine and the largest at the end of its right
+    // spine, so children again come first.
+    subtreeHeight = subHeight;
+    subtreeMinX.assign(n, 0);
+    subtreeMaxX.assign(n, 0);
+    minKey.assign(n, 0);
+    maxKey.assign(n, 0);
+    for (int v = n - 1; v >= 0; --v) {
+        subtreeMinX[v] = x[v] + minX[v];
+        subtreeMaxX[v] = x[v] + maxX[v];
+        minKey[v] = left[v] >= 0 ? minKey[left[v]] : keys[v];
+        maxKey[v] = right[v] >= 0 ? maxKey[right[v]] : keys[v];
+    }
+
+    byKey.clear();
+    byKey.reserve(n);
+    std::vector<int> stack;
+    for (int v = 0; v >= 0 || !stack.empty();) {
+        if (v >= 0) {
+            stack.push_back(v);
+            v = left[v];
+        }
+        else {
+            v = stack.back();
+            stack.pop_back();
+            byKey.push_back(v);
+            v = right[v];
+        }
+    }
+}
+
+int TreeLayout::find(int key) const {
+    auto it = std::lower_bound(byKey.begin(), byKey.end(), key,
+        [&](int i, int k) { return keys[i] < k; });
+    return it != byKey.end() && keys[*it] == key ? *it : -1;
+}
+
+int TreeLayout::rank(int key) const {
+    auto it = std::lower_bound(byKey.begin(), byKey.end(), key,
+        [&](int i, int k) { return keys[i] < k; });
+    return (int)(it - byKey.begin());
+}
+
+bool TreeLayout::setRed(int key, bool isRed) {
+    int i = find(key);
+    if (i < 0) return false;
+    red[i] = isRed;
+    return true;
+}
+
+// Only valid when newKey keeps its place in key order, which is the only
+// case where the trees rewrite a key without reshaping.
+bool TreeLayout::rekey(int oldKey, int newKey) {
+    int i = find(oldKey);
+    if (i < 0) return false;
+    keys[i] = newKey;
+    for (int v = i; v >= 0; v = parent[v]) {
+        minKey[v] = left[v] >= 0 ? minKey[left[v]] : keys[v];
+        maxKey[v] = right[v] >= 0 ? maxKey[right[v]] : keys[v];
+    }
+    return true;
+}
+
+void TreeLayout::query(double x0, double y0, double x1, double y1, double margin,
+                       std::vector<int>& nodes, std::vector<int>& edges) const {
+    nodes.clear();
+    edges.clear();
+    if (rows.empty() || x0 > x1 || y0 > y1) return;
+
+    int last = (int)rows.size() - 1;
+    int first = std::max(0, (int)std::floor((y0 - margin) / levelSeparation));
+    int end = std::min(last, (int)std::ceil((y1 + margin) / levelSeparation));
+
+    // Index of the first node in row r whose x is at least v
+    auto lowerBound = [&](int r, double v) {
+        const std::vector<int>& row = rows[r];
+        return (int)(std::lower_bound(row.begin(), row.end(), v,
+            [&](int i, double value) { return x[i] < value; }) - row.begin());
+    };
+
+    for (int r = first; r <= end; ++r) {
+        const std::vector<int>& row = rows[r];
+        for (int k = lowerBound(r, x0 - margin); k < (int)row.size() && x[row[k]] <= x1 + margin; ++k)
+            nodes.push_back(row[k]);
+    }
+
+    // An edge into row r runs between the levels r - 1 and r, and its child
+    // is at most rowSpan[r] away from the parent horizontally.
+    int edgeFirst = std::max(1, (int)std::floor(y0 / levelSeparation));
+    int edgeEnd = std::min(last, (int)std::ceil(y1 / levelSeparation) + 1);
+    for (int r = edgeFirst; r <= edgeEnd; ++r) {
+        const std::vector<int>& row = rows[r];
+        for (int k = lowerBound(r, x0 - rowSpan[r]); k < (int)row.size() && x[row[k]] <= x1 + rowSpan[r]; ++k) {
+            int c = row[k];
+            double px = x[parent[c]];
+            if (std::max(px, x[c]) >= x0 && std::min(px, x[c]) <= x1)
+                edges.push_back(c);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef TREELAYOUT_H
+#define TREELAYOUT_H
+
+#include <vector>
+#include "BST.h"
+#include "PersistentTree.h"
+#include "RBTree.h"
+
+// Tidy drawing of a binary tree (Reingold-Tilford).
+// Subtrees are laid out bottom-up and pushed apart only as far as their
+// facing contours require, so the whole layout is O(n) and never recurses.
+// Nodes are stored in preorder; parent/left/right are indices into the
+// same arrays (-1 when absent).
+class TreeLayout {
+public:
+    TreeLayout(double siblingSeparation = 70, double levelSeparation = 120);
+
+    void build(BSTNode* root);
+    void build(RBNode* root);
+    void build(const VersionNode* root);
+    void clear();
+    int count() const { return (int)keys.size(); }
+
+    double siblingSeparation; // minimum distance between nodes on one level
+    double levelSeparation;   // vertical distance between levels
+
+    std::vector<int> keys;
+    std::vector<int> parent;
+    std::vector<int> left;
+    std::vector<int> right;
+    std::vector<int> level;
+    std::vector<char> red;
+    std::vector<double> x; // left-most node is at 0
+    std::vector<double> y;
+
+    double width;
+    double height;
+    long long depthTotal; // sum of level over all nodes
+
+    // Per-subtree summaries, indexed by subtree root: node count (the trees'
+    // own size augmentation), levels below the root, horizontal extent and
+    // key range.
+    std::vector<int> subtreeSize;
+    std::vector<int> subtreeHeight;
+    std::vector<double> subtreeMinX;
+    std::vector<double> subtreeMaxX;
+    std::vector<int> minKey;
+    std::vector<int> maxKey;
+
+    // Node indices in key order (the in-order walk), used by find()
+    std::vector<int> byKey;
+    int find(int key) const;    // index of key, or -1
+    int rank(int key) const;    // number of keys smaller than key
+
+    // Updates that leave the shape and every position as they are
+    bool setRed(int key, bool red);
+    bool rekey(int oldKey, int newKey);
+
+    // Spatial index: the nodes of each level from left to right, and per
+    // level the widest horizontal distance between a node and its parent.
+    std::vector<std::vector<int>> rows;
+    std::vector<double> rowSpan;
+
+    // Collects the nodes within `margin` of the box [x0, x1] x [y0, y1] and
+    // the nodes whose edge to their parent may cross it.
+    // O(log n + output) per level in the box.
+    void query(double x0, double y0, double x1, double y1, double margin,
+               std::vector<int>& nodes, std::vector<int>& edges) const;
+
+private:
+    template <typename Node> void collect(Node* root);
+    void place();
+};
+
+#endif // TREELAYOUT_H
\ No newline at end of file
@@ -1,7 +1,52 @@
 #include "TreeManager.h"
+#include "TreeWorker.h"
+#include <QCoreApplication>
 #include <QFile>
+#include <QPromise>
 #include <QTextStream>
-#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+// Journal records accumulated before the snapshot file is rewritten.
+static const int CheckpointInterval = 1000;
+
+// Sorted keys median first, the order BST::insertBatch inserts them in
+static void medianOrder(const std::vector<int>& sorted, int lo, int hi, std::vector<int>& out)
+{
+    if (lo > hi) return;
+    int mid = lo + (hi - lo) / 2;
+    out.push_back(sorted[mid]);
+    medianOrder(sorted, lo, mid - 1, out);
+    medianOrder(sorted, mid + 1, hi, out);
+}
+
+template <typename Tree>
+static void replayLog(const OperationLog& log, Tree* tree)
+{
+    for (const OperationLog::Record& r : log.readAll()) {
+        if (r.op == OperationLog::Insert)
+            tree->insert(r.key, r.key);
+        else if (r.op == OperationLog::Delete)
+            tree->remove(r.key);
+        else if (r.op == OperationLog::Clear)
+            tree->clearTree();
+    }
+}
+
+// (kind, key, other) triples, as carried by treeChanged
+static QVariantList flatten(const std::vector<TreeChange>& changes)
+{
+    QVariantList flat;
+    flat.reserve(3 * static_cast<int>(changes.size()));
+    for (const TreeChange& c : changes) {
+        flat.append(int(c.kind));
+        flat.append(c.key);
+        flat.append(c.other);
+    }
+    return flat;
+}
 
 TreeManager::TreeManager(QObject* parent)
     : QObject(parent)
@@ -9,98 +54,334 @@ TreeManager::TreeManager(QObject* parent)
     , m_avl(new AVL())
     , m_rbTree(new RBTree())
     , m_currentTreeType("BST")
+    , m_treeType("BST")
+    , m_worker(nullptr)
+    , m_pendingCommands(0)
+    , m_batchCommands(0)
+    , m_bstLog("bst.log")
+    , m_avlLog("avl.log")
+    , m_rbLog("rb.log")
+    , m_avlHistory(m_avlVersions)
+    , m_rbHistory(m_rbVersions)
+    , m_avlStale(false)
+    , m_rbStale(false)
+    , m_avlPublished(m_avlVersions)
+    , m_rbPublished(m_rbVersions)
+    , m_versionIndex(0)
+    , m_versionCount(0)
+    , m_layoutTreeType("BST")
+    , m_layoutValid(false)
 {
-    // Load existing trees from files
-    loadFromFile("bst.txt");
-    loadFromFile("avl.txt");
-    loadFromFile("rb.txt");
+    // Load the last snapshots, then replay what was journaled after them
+    loadFromFile("bst.bin");
+    loadFromFile("avl.bin");
+    loadFromFile("rb.bin");
+    replayLog(m_bstLog, m_bst);
+    replayLog(m_avlLog, m_avl);
+    replayLog(m_rbLog, m_rbTree);
+    m_avlHistory.reset(m_avlVersions.capture(m_avl->root));
+    m_rbHistory.reset(m_rbVersions.capture(m_rbTree->root));
+    m_avlPublished.publish(m_avlHistory.current());
+    m_rbPublished.publish(m_rbHistory.current());
+
+    // Nobody has seen the trees yet, so what they recorded is moot
+    m_bst->changes.take();
+    m_avl->changes.take();
+    m_rbTree->changes.take();
 }
 
 TreeManager::~TreeManager()
 {
+    delete m_worker;
     delete m_bst;
     delete m_avl;
     delete m_rbTree;
 }
 
+// The worker is stopped only after it ran everything queued, and its last
+// results are delivered before the trees are touched from here again.
+void TreeManager::setThreaded(bool threaded)
+{
+    if (threaded == this->threaded()) return;
+
+    if (threaded) {
+        // Queries are answered from the layout until the first snapshot
+        ensureLayout();
+        m_worker = new TreeWorker([this] { flushBatch(); });
+        m_worker->start();
+    }
+    else {
+        m_worker->stop();
+        delete m_worker;
+        m_worker = nullptr;
+        QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+    }
+    emit threadedChanged();
+}
+
+QFuture<void> TreeManager::settled()
+{
+    auto promise = std::make_shared<QPromise<void>>();
+    promise->start();
+    QFuture<void> future = promise->future();
+    submit([this, promise] {
+        notify([promise] { promise->finish(); });
+    });
+    return future;
+}
+
+// Runs a command that touches the trees: right away, or on the worker
+void TreeManager::submit(std::function<void()> command)
+{
+    if (!m_worker) {
+        command();
+        return;
+    }
+    if (m_pendingCommands++ == 0) emit busyChanged();
+    m_worker->post([this, command] {
+        command();
+        ++m_batchCommands;
+    });
+}
+
+// Emits now, or once the worker's current batch is handed over
+void TreeManager::notify(std::function<void()> signal)
+{
+    if (m_worker) m_outbox.push_back(std::move(signal));
+    else signal();
+}
+
+// Worker thread, whenever its queue runs dry. The layout is built here and
+// never touched by the worker again; this object's thread takes it over
+// together with the changes and signals of the batch, in that order.
+void TreeManager::flushBatch()
+{
+    if (m_batchCommands == 0) return;
+
+    std::vector<TreeChange> changes = m_batchChanges.take();
+    std::shared_ptr<TreeLayout> snapshot;
+    QString type = m_treeType;
+    if (!changes.empty()) {
+        snapshot = std::make_shared<TreeLayout>();
+        buildLayout(*snapshot);
+    }
+    std::vector<std::function<void()>> outbox;
+    outbox.swap(m_outbox);
+    int commands = m_batchCommands;
+    m_batchCommands = 0;
+
+    QMetaObject::invokeMethod(this, [this, changes, snapshot, type, outbox, commands] {
+        if (snapshot) {
+            m_layout = std::move(*snapshot);
+            m_layoutTreeType = type;
+            m_layoutValid = true;
+            m_layoutCache.clear();
+            m_packedLayout.clear();
+            emit treeChanged(flatten(changes));
+        }
+        for (const auto& signal : outbox) {
+            signal();
+        }
+        m_pendingCommands -= commands;
+        if (m_pendingCommands == 0) emit busyChanged();
+    }, Qt::QueuedConnection);
+}
+
 void TreeManager::setTreeType(const QString& type)
 {
     if (m_currentTreeType != type) {
         m_currentTreeType = type;
         emit currentTreeTypeChanged();
-        emit treeUpdated();
+        submit([this, type] {
+            m_treeType = type;
+            publishChanges({ TreeChange{ TreeChange::Reset, 0, 0 } });
+            publishHistory();
+            notify([this] {
+                m_lastStats = TreeStats();
+                emit statsChanged();
+                emit treeUpdated();
+            });
+        });
     }
 }
 
 void TreeManager::insertNode(int key)
 {
-    if (m_currentTreeType == "BST") {
-        m_bst->insert(key, key);
-        saveToFile("bst.txt");
+    tryInsert(key);
+}
+
+// Duplicate check and insert in one walk; insertFinished reports which it
+// was. When threaded the check runs on the worker against the tree itself,
+// not against the last snapshot, so queued inserts of one key see each other.
+void TreeManager::tryInsert(int key)
+{
+    submit([this, key] { insertKey(key); });
+}
+
+void TreeManager::insertKey(int key)
+{
+    restoreEditable();
+    TreeStats before = currentStats();
+    bool inserted = false;
+    int depth = -1;
+
+    if (m_treeType == "BST") {
+        BST::InsertResult r = m_bst->tryInsert(key, key);
+        inserted = r.inserted;
+        depth = r.depth;
+    }
+    else if (m_treeType == "AVL") {
+        BST::InsertResult r = m_avl->tryInsert(key, key);
+        inserted = r.inserted;
+        depth = r.depth;
+    }
+    else if (m_treeType == "RB") {
+        RBTree::InsertResult r = m_rbTree->tryInsert(key, key);
+        inserted = r.inserted;
+        depth = r.depth;
+    }
+
+    if (inserted) {
+        if (VersionHistory* history = currentHistory()) history->insert(key, key);
+        logOperation(OperationLog::Insert, key);
+        publishChanges();
+        publishHistory();
+        notify([this, key] {
+            emit nodeInserted(key);
+            emit treeUpdated();
+        });
+    }
+    publishStats(before);
+
+    notify([this, key, inserted, depth] {
+        emit insertFinished(key, inserted, depth);
+    });
+}
+
+// Many keys in one command: sorted, deduplicated and merged in on all
+// cores instead of one insertNode per key
+void TreeManager::insertBatch(const QList<int>& keys)
+{
+    std::vector<int> batch(keys.begin(), keys.end());
+    submit([this, batch] { insertKeys(batch); });
+}
+
+void TreeManager::insertKeys(std::vector<int> keys)
+{
+    restoreEditable();
+    TreeStats before = currentStats();
+    int added = 0;
+    if (m_treeType == "BST") {
+        added = m_bst->insertBatch(keys);
     }
-    else if (m_currentTreeType == "AVL") {
-        m_avl->insert(key, key);
-        saveToFile("avl.txt");
+    else if (m_treeType == "AVL") {
+        added = m_avl->insertBatch(keys);
     }
-    else if (m_currentTreeType == "RB") {
-        m_rbTree->insert(key, key);
-        saveToFile("rb.txt");
+    else if (m_treeType == "RB") {
+        added = m_rbTree->insertBatch(keys);
     }
 
-    emit nodeInserted(key);
-    emit treeUpdated();
+    if (added > 0) {
+        // keys now holds the batch sorted and deduplicated; the version
+        // merges it in with the same joins as the tree, so it keeps its shape
+        if (VersionHistory* history = currentHistory()) history->insertBatch(keys);
+
+        // Median first, so replaying the journal rebuilds the same BST
+        OperationLog& log = currentLog();
+        if (log.size() + static_cast<int>(keys.size()) >= CheckpointInterval) {
+            checkpoint();
+        }
+        else {
+            std::vector<int> order;
+            order.reserve(keys.size());
+            medianOrder(keys, 0, static_cast<int>(keys.size()) - 1, order);
+            for (int k : order) log.append(OperationLog::Insert, k);
+        }
+
+        publishChanges();
+        publishHistory();
+        notify([this] { emit treeUpdated(); });
+    }
+    publishStats(before);
 }
 
 void TreeManager::deleteNode(int key)
 {
-    if (m_currentTreeType == "BST") {
-        m_bst->remove(key);
-        saveToFile("bst.txt");
+    submit([this, key] { removeKey(key); });
+}
+
+void TreeManager::removeKey(int key)
+{
+    restoreEditable();
+    TreeStats before = currentStats();
+    bool removed = false;
+    if (m_treeType == "BST") {
+        removed = m_bst->remove(key);
     }
-    else if (m_currentTreeType == "AVL") {
-        m_avl->remove(key);
-        saveToFile("avl.txt");
+    else if (m_treeType == "AVL") {
+        removed = m_avl->remove(key);
     }
-    else if (m_currentTreeType == "RB") {
-        m_rbTree->remove(key);
-        saveToFile("rb.txt");
+    else if (m_treeType == "RB") {
+        removed = m_rbTree->remove(key);
     }
 
-    emit nodeDeleted(key);
-    emit treeUpdated();
+    if (removed) {
+        if (VersionHistory* history = currentHistory()) history->remove(key);
+        logOperation(OperationLog::Delete, key);
+        publishChanges();
+        publishHistory();
+        notify([this, key] {
+            emit nodeDeleted(key);
+            emit treeUpdated();
+        });
+    }
+    publishStats(before);
 }
 
+// When threaded the search runs against the snapshot and counts nothing
 bool TreeManager::searchNode(int key)
 {
+    if (!m_worker) restoreEditable();
     BST::SearchResult result;
+    TreeStats before = m_worker ? TreeStats() : currentStats();
 
-    if (m_currentTreeType == "BST") {
+    if (m_worker) {
+        result.found = m_layout.find(key) >= 0;
+    }
+    else if (m_treeType == "BST") {
         result = m_bst->search(key);
     }
-    else if (m_currentTreeType == "AVL") {
+    else if (m_treeType == "AVL") {
         result = m_avl->search(key);
     }
-    else if (m_currentTreeType == "RB") {
+    else if (m_treeType == "RB") {
         auto rbResult = m_rbTree->search(key);
         result.found = rbResult.found;
         result.depth = rbResult.depth;
     }
+    if (!m_worker) publishStats(before);
 
     return result.found;
 }
 
 QVariantList TreeManager::getInorderTraversal()
 {
+    if (!m_worker) restoreEditable();
     QVariantList result;
     std::vector<int> keys;
 
-    if (m_currentTreeType == "BST") {
+    if (m_worker) {
+        for (int i : m_layout.byKey) {
+            keys.push_back(m_layout.keys[i]);
+        }
+    }
+    else if (m_treeType == "BST") {
         keys = m_bst->inorderKeys();
     }
-    else if (m_currentTreeType == "AVL") {
+    else if (m_treeType == "AVL") {
         keys = m_avl->inorderKeys();
     }
-    else if (m_currentTreeType == "RB") {
+    else if (m_treeType == "RB") {
         keys = m_rbTree->inorderKeys();
     }
 
@@ -113,16 +394,20 @@ QVariantList TreeManager::getInorderTraversal()
 
 QVariantList TreeManager::getPreorderTraversal()
 {
+    if (!m_worker) restoreEditable();
     QVariantList result;
     std::vector<int> keys;
 
-    if (m_currentTreeType == "BST") {
+    if (m_worker) {
+        keys = m_layout.keys;   // the layout is in preorder
+    }
+    else if (m_treeType == "BST") {
         keys = m_bst->preorderKeys();
     }
-    else if (m_currentTreeType == "AVL") {
+    else if (m_treeType == "AVL") {
         keys = m_avl->preorderKeys();
     }
-    else if (m_currentTreeType == "RB") {
+    else if (m_treeType == "RB") {
         keys = m_rbTree->preorderKeys();
     }
 
@@ -135,16 +420,30 @@ QVariantList TreeManager::getPreorderTraversal()
 
 QVariantList TreeManager::getPostorderTraversal()
 {
+    if (!m_worker) restoreEditable();
     QVariantList result;
     std::vector<int> keys;
 
-    if (m_currentTreeType == "BST") {
+    if (m_worker) {
+        // Root, right, left, reversed
+        std::vector<int> stack;
+        if (m_layout.count() > 0) stack.push_back(0);
+        while (!stack.empty()) {
+            int v = stack.back();
+            stack.pop_back();
+            keys.push_back(m_layout.keys[v]);
+            if (m_layout.left[v] >= 0) stack.push_back(m_layout.left[v]);
+            if (m_layout.right[v] >= 0) stack.push_back(m_layout.right[v]);
+        }
+        std::reverse(keys.begin(), keys.end());
+    }
+    else if (m_treeType == "BST") {
         keys = m_bst->postorderKeys();
     }
-    else if (m_currentTreeType == "AVL") {
+    else if (m_treeType == "AVL") {
         keys = m_avl->postorderKeys();
     }
-    else if (m_currentTreeType == "RB") {
+    else if (m_treeType == "RB") {
         keys = m_rbTree->postorderKeys();
     }
 
@@ -155,183 +454,668 @@ QVariantList TreeManager::getPostorderTraversal()
     return result;
 }
 
-void TreeManager::clearTree()
+int TreeManager::size()
 {
-    if (m_currentTreeType == "BST") {
-        m_bst->clearTree();
-        saveToFile("bst.txt");
+    if (!m_worker) restoreEditable();
+    if (m_worker) {
+        return m_layout.count();
     }
-    else if (m_currentTreeType == "AVL") {
-        m_avl->clearTree();
-        saveToFile("avl.txt");
+    else if (m_treeType == "BST") {
+        return m_bst->size();
     }
-    else if (m_currentTreeType == "RB") {
-        m_rbTree->clearTree();
-        saveToFile("rb.txt");
+    else if (m_treeType == "AVL") {
+        return m_avl->size();
+    }
+    else if (m_treeType == "RB") {
+        return m_rbTree->size();
     }
+    return 0;
+}
 
-    emit treeCleared();
-    emit treeUpdated();
+int TreeManager::rank(int key)
+{
+    if (!m_worker) restoreEditable();
+    if (m_worker) {
+        return m_layout.rank(key);
+    }
+    else if (m_treeType == "BST") {
+        return m_bst->rank(key);
+    }
+    else if (m_treeType == "AVL") {
+        return m_avl->rank(key);
+    }
+    else if (m_treeType == "RB") {
+        return m_rbTree->rank(key);
+    }
+    return 0;
 }
 
-// Helper to update value within vector of keys for BST/AVL/RB
-static bool updateInVector(std::vector<int>& keys, int oldValue, int occurrenceIndex, int newValue, const QString& mode)
+// Returns the k-th smallest key (1-based), or an undefined value when k is out of range.
+QVariant TreeManager::select(int k)
 {
-    if (mode == "beginning") {
-        if (!keys.empty()) { keys.front() = newValue; return true; }
-        return false;
+    if (!m_worker) restoreEditable();
+    if (m_worker) {
+        if (k >= 1 && k <= m_layout.count()) return m_layout.keys[m_layout.byKey[k - 1]];
     }
-    else if (mode == "end") {
-        if (!keys.empty()) { keys.back() = newValue; return true; }
-        return false;
+    else if (m_treeType == "BST") {
+        if (BSTNode* n = m_bst->select(k)) return n->key;
     }
-    else { // any with occurrenceIndex (1-based)
-        int count = 0;
-        for (size_t i = 0; i < keys.size(); ++i) {
-            if (keys[i] == oldValue) {
-                ++count;
-                if (count == occurrenceIndex) { keys[i] = newValue; return true; }
-            }
+    else if (m_treeType == "AVL") {
+        if (BSTNode* n = m_avl->select(k)) return n->key;
+    }
+    else if (m_treeType == "RB") {
+        if (RBNode* n = m_rbTree->select(k)) return n->key;
+    }
+    return QVariant();
+}
+
+QVariantList TreeManager::rangeKeys(int lo, int hi)
+{
+    if (!m_worker) restoreEditable();
+    QVariantList result;
+    std::vector<int> keys;
+
+    if (m_worker) {
+        int first = m_layout.rank(lo);
+        int count = rangeCount(lo, hi);
+        for (int r = first; r < first + count; ++r) {
+            keys.push_back(m_layout.keys[m_layout.byKey[r]]);
         }
-        return false;
     }
+    else if (m_treeType == "BST") {
+        keys = m_bst->rangeKeys(lo, hi);
+    }
+    else if (m_treeType == "AVL") {
+        keys = m_avl->rangeKeys(lo, hi);
+    }
+    else if (m_treeType == "RB") {
+        keys = m_rbTree->rangeKeys(lo, hi);
+    }
+
+    result.reserve(static_cast<int>(keys.size()));
+    for (int key : keys) {
+        result.append(key);
+    }
+
+    return result;
+}
+
+int TreeManager::rangeCount(int lo, int hi)
+{
+    if (!m_worker) restoreEditable();
+    if (m_worker) {
+        if (lo > hi) return 0;
+        int upTo = hi == std::numeric_limits<int>::max() ? m_layout.count() : m_layout.rank(hi + 1);
+        return upTo - m_layout.rank(lo);
+    }
+    else if (m_treeType == "BST") {
+        return m_bst->rangeCount(lo, hi);
+    }
+    else if (m_treeType == "AVL") {
+        return m_avl->rangeCount(lo, hi);
+    }
+    else if (m_treeType == "RB") {
+        return m_rbTree->rangeCount(lo, hi);
+    }
+    return 0;
+}
+
+void TreeManager::clearTree()
+{
+    submit([this] { clearCurrent(); });
 }
 
-// Implementation of updateNode declared in header
-bool TreeManager::updateNode(int oldValue, int occurrenceIndex, int newValue, const QString& mode)
+void TreeManager::clearCurrent()
 {
-    // Approach: Rebuild tree from traversal keys with updated value.
-    if (m_currentTreeType == "BST") {
-        auto keys = m_bst->inorderKeys();
-        bool ok = updateInVector(keys, oldValue, occurrenceIndex, newValue, mode);
-        if (!ok) return false;
+    // Cleared first, the version makes a pending rebuild free
+    VersionHistory* history = currentHistory();
+    if (history && history->current()) history->clear();
+    restoreEditable();
+
+    TreeStats before = currentStats();
+    if (m_treeType == "BST") {
         m_bst->clearTree();
-        for (int k : keys) m_bst->insert(k, k);
-        saveToFile("bst.txt");
-        emit treeUpdated();
-        return true;
     }
-    else if (m_currentTreeType == "AVL") {
-        auto keys = m_avl->inorderKeys();
-        bool ok = updateInVector(keys, oldValue, occurrenceIndex, newValue, mode);
-        if (!ok) return false;
+    else if (m_treeType == "AVL") {
         m_avl->clearTree();
-        for (int k : keys) m_avl->insert(k, k);
-        saveToFile("avl.txt");
-        emit treeUpdated();
-        return true;
     }
-    else if (m_currentTreeType == "RB") {
-        auto keys = m_rbTree->inorderKeys();
-        bool ok = updateInVector(keys, oldValue, occurrenceIndex, newValue, mode);
-        if (!ok) return false;
+    else if (m_treeType == "RB") {
         m_rbTree->clearTree();
-        for (int k : keys) m_rbTree->insert(k, k);
-        saveToFile("rb.txt");
+    }
+    // An empty snapshot is cheap, so checkpoint instead of journaling
+    checkpoint();
+    publishChanges();
+    publishStats(before);
+    publishHistory();
+
+    notify([this] {
+        emit treeCleared();
         emit treeUpdated();
-        return true;
+    });
+}
+
+// Updates one key in place. "beginning"/"end" target the smallest/largest
+// key; otherwise oldValue is used, and since keys are unique only its first
+// occurrence can exist. updateFinished reports whether it was applied.
+void TreeManager::updateNode(int oldValue, int occurrenceIndex, int newValue, const QString& mode)
+{
+    submit([this, oldValue, occurrenceIndex, newValue, mode] {
+        updateKey(oldValue, occurrenceIndex, newValue, mode);
+    });
+}
+
+// Resolves the target against the tree itself, on the worker when threaded
+void TreeManager::updateKey(int oldValue, int occurrenceIndex, int newValue, const QString& mode)
+{
+    restoreEditable();
+    bool ok = false;
+    int target = oldValue;
+    if (mode == "beginning" || mode == "end") {
+        bool first = mode == "beginning";
+        int found = 0;
+        if (m_treeType == "BST") {
+            found = m_bst->size();
+            if (found > 0) target = m_bst->select(first ? 1 : found)->key;
+        }
+        else if (m_treeType == "AVL") {
+            found = m_avl->size();
+            if (found > 0) target = m_avl->select(first ? 1 : found)->key;
+        }
+        else if (m_treeType == "RB") {
+            found = m_rbTree->size();
+            if (found > 0) target = m_rbTree->select(first ? 1 : found)->key;
+        }
+        ok = found > 0 && replaceKey(target, newValue);
+    }
+    else if (occurrenceIndex == 1) {
+        ok = replaceKey(target, newValue);
     }
+
+    notify([this, oldValue, newValue, ok] {
+        emit updateFinished(oldValue, newValue, ok);
+    });
+}
+
+bool TreeManager::replaceKey(int target, int newValue)
+{
+    restoreEditable();
+    TreeStats before = currentStats();
+    bool ok = false;
+    if (m_treeType == "BST") {
+        ok = m_bst->updateKey(target, newValue);
+    }
+    else if (m_treeType == "AVL") {
+        ok = m_avl->updateKey(target, newValue);
+    }
+    else if (m_treeType == "RB") {
+        ok = m_rbTree->updateKey(target, newValue);
+    }
+    if (!ok) {
+        publishStats(before);
+        return false;
+    }
+
+    if (target != newValue) {
+        if (VersionHistory* history = currentHistory()) history->updateKey(target, newValue);
+        logOperation(OperationLog::Delete, target);
+        logOperation(OperationLog::Insert, newValue);
+    }
+    publishChanges();
+    publishStats(before);
+    publishHistory();
+
+    notify([this, target, newValue] {
+        emit nodeUpdated(target, newValue);
+        emit treeUpdated();
+    });
+    return true;
+}
+
+bool TreeManager::statsEnabled() const
+{
+#ifdef BINARYST_STATS
+    return true;
+#else
     return false;
+#endif
+}
+
+int TreeManager::treeHeight()
+{
+    const TreeLayout& l = layout();
+    return l.count() > 0 ? l.subtreeHeight[0] + 1 : 0;
+}
+
+int TreeManager::treeSize()
+{
+    return layout().count();
+}
+
+// Mean number of edges from the root, over all nodes
+double TreeManager::averageDepth()
+{
+    const TreeLayout& l = layout();
+    return l.count() > 0 ? double(l.depthTotal) / l.count() : 0;
+}
+
+// Worker side when threaded, like the trees themselves
+TreeStats TreeManager::currentStats() const
+{
+    if (m_treeType == "AVL") return m_avl->stats;
+    if (m_treeType == "RB") return m_rbTree->stats;
+    return m_bst->stats;
+}
+
+// What the trees counted since before, shown once the operation is visible
+void TreeManager::publishStats(const TreeStats& before)
+{
+    TreeStats delta = currentStats() - before;
+    notify([this, delta] {
+        m_lastStats = delta;
+        emit statsChanged();
+    });
+}
+
+void TreeManager::invalidateLayout()
+{
+    m_layoutValid = false;
+}
+
+// Recoloring and in-place rekeying keep every position, so the cached
+// layout is patched; anything that reshapes the tree drops it.
+void TreeManager::applyToLayout(const std::vector<TreeChange>& changes)
+{
+    if (!m_layoutValid) return;
+    for (const TreeChange& c : changes) {
+        if (c.kind != TreeChange::Recolored && c.kind != TreeChange::Rekeyed) {
+            invalidateLayout();
+            return;
+        }
+    }
+    for (const TreeChange& c : changes) {
+        if (c.kind == TreeChange::Recolored) m_layout.setRed(c.key, c.other != 0);
+        else m_layout.rekey(c.key, c.other);
+    }
+    m_layoutCache.clear();
+    m_packedLayout.clear();
 }
 
-void TreeManager::buildTreeStructure(BSTNode* node, QVariantList& list, int level, double x, double xOffset)
+// Hands what the current tree recorded to the layout cache and to views
+void TreeManager::publishChanges()
 {
-    if (!node) return;
+    std::vector<TreeChange> changes;
+    if (m_treeType == "BST") {
+        changes = m_bst->changes.take();
+    }
+    else if (m_treeType == "AVL") {
+        changes = m_avl->changes.take();
+    }
+    else if (m_treeType == "RB") {
+        changes = m_rbTree->changes.take();
+    }
+    publishChanges(changes);
+}
 
-    QVariantMap nodeData;
-    nodeData["key"] = node->key;
-    nodeData["level"] = level;
-    nodeData["x"] = x;
-    nodeData["color"] = "blue";
-    nodeData["parent"] = node->parent ? node->parent->key : -1;
+// On the worker, changes only pile up until the next snapshot
+void TreeManager::publishChanges(const std::vector<TreeChange>& changes)
+{
+    if (changes.empty()) return;
+
+    if (m_worker) {
+        for (const TreeChange& c : changes) {
+            if (c.kind == TreeChange::Reset) m_batchChanges.reset();
+            else m_batchChanges.record(c.kind, c.key, c.other);
+        }
+        return;
+    }
 
-    list.append(nodeData);
+    applyToLayout(changes);
+    emit treeChanged(flatten(changes));
+}
 
-    double newOffset = xOffset * 0.5;
-    if (node->left) {
-        buildTreeStructure(node->left, list, level + 1, x - xOffset, newOffset);
+void TreeManager::buildLayout(TreeLayout& out) const
+{
+    if (m_treeType == "BST") {
+        out.build(m_bst->root);
+    }
+    else if (m_treeType == "AVL") {
+        if (m_avlStale) out.build(m_avlHistory.current());
+        else out.build(m_avl->root);
+    }
+    else if (m_treeType == "RB") {
+        if (m_rbStale) out.build(m_rbHistory.current());
+        else out.build(m_rbTree->root);
     }
-    if (node->right) {
-        buildTreeStructure(node->right, list, level + 1, x + xOffset, newOffset);
+    else {
+        out.clear();
     }
 }
 
-void TreeManager::buildRBTreeStructure(RBNode* node, QVariantList& list, int level, double x, double xOffset)
+// When threaded the trees belong to the worker, and the layout is whatever
+// snapshot it handed over last.
+void TreeManager::ensureLayout()
+{
+    if (m_layoutValid || m_worker) return;
+
+    buildLayout(m_layout);
+    m_layoutTreeType = m_treeType;
+
+    // Exports are filled on first request
+    m_layoutCache.clear();
+    m_packedLayout.clear();
+    m_layoutValid = true;
+}
+
+const TreeLayout& TreeManager::layout()
+{
+    ensureLayout();
+    return m_layout;
+}
+
+// Node positions from the tidy layout, cached until the tree changes.
+// Returns { width, height, nodes }, each node being
+// { key, level, x, y, color, parent } in preorder.
+QVariantMap TreeManager::getTreeLayout()
 {
-    if (!node) return;
+    ensureLayout();
+    if (!m_layoutCache.isEmpty()) return m_layoutCache;
+
+    bool rb = m_layoutTreeType == "RB";
+    QVariantList nodes;
+    nodes.reserve(m_layout.count());
+    for (int i = 0; i < m_layout.count(); ++i) {
+        QVariantMap nodeData;
+        nodeData["key"] = m_layout.keys[i];
+        nodeData["level"] = m_layout.level[i];
+        nodeData["x"] = m_layout.x[i];
+        nodeData["y"] = m_layout.y[i];
+        nodeData["color"] = rb ? (m_layout.red[i] ? "red" : "black") : "blue";
+        nodeData["parent"] = m_layout.parent[i] >= 0 ? m_layout.keys[m_layout.parent[i]] : -1;
+        nodes.append(nodeData);
+    }
+
+    m_layoutCache["width"] = m_layout.width;
+    m_layoutCache["height"] = m_layout.height;
+    m_layoutCache["nodes"] = nodes;
+    return m_layoutCache;
+}
 
-    QVariantMap nodeData;
-    nodeData["key"] = node->key;
-    nodeData["level"] = level;
-    nodeData["x"] = x;
-    nodeData["color"] = node->red ? "red" : "black";
-    nodeData["parent"] = node->parent ? node->parent->key : -1;
+// Same layout as one flat buffer (an ArrayBuffer in QML), so no per-node
+// objects are created. All values are native-endian and every array starts
+// on a multiple of its element size:
+//
+//   Float64 header[3]  count n, width, height
+//   Float64 x[n]
+//   Float64 y[n]
+//   Int32   key[n]
+//   Int32   parent[n]  index of the parent node, -1 for the root
+//   Int32   level[n]
+//   Uint8   color[n]   0 = blue, 1 = red, 2 = black
+//
+// Nodes are in preorder, so a parent always comes before its children.
+QByteArray TreeManager::getPackedTreeLayout()
+{
+    ensureLayout();
+    if (!m_packedLayout.isEmpty()) return m_packedLayout;
 
-    list.append(nodeData);
+    int n = m_layout.count();
+    qsizetype doubles = (3 + 2 * qsizetype(n)) * qsizetype(sizeof(double));
+    qsizetype ints = 3 * qsizetype(n) * qsizetype(sizeof(qint32));
+    m_packedLayout.resize(doubles + ints + n);
 
-    double newOffset = xOffset * 0.5;
-    if (node->left) {
-        buildRBTreeStructure(node->left, list, level + 1, x - xOffset, newOffset);
+    double header[3] = { double(n), m_layout.width, m_layout.height };
+    char* p = m_packedLayout.data();
+    std::memcpy(p, header, sizeof(header));
+    p += sizeof(header);
+    if (n > 0) {
+        std::memcpy(p, m_layout.x.data(), n * sizeof(double));
+        p += n * sizeof(double);
+        std::memcpy(p, m_layout.y.data(), n * sizeof(double));
+        p += n * sizeof(double);
+        std::memcpy(p, m_layout.keys.data(), n * sizeof(qint32));
+        p += n * sizeof(qint32);
+        std::memcpy(p, m_layout.parent.data(), n * sizeof(qint32));
+        p += n * sizeof(qint32);
+        std::memcpy(p, m_layout.level.data(), n * sizeof(qint32));
+        p += n * sizeof(qint32);
     }
-    if (node->right) {
-        buildRBTreeStructure(node->right, list, level + 1, x + xOffset, newOffset);
+
+    bool rb = m_layoutTreeType == "RB";
+    for (int i = 0; i < n; ++i) {
+        p[i] = char(rb ? (m_layout.red[i] ? 1 : 2) : 0);
     }
+
+    return m_packedLayout;
 }
 
 QVariantList TreeManager::getTreeStructure()
 {
-    QVariantList result;
+    return getTreeLayout()["nodes"].toList();
+}
 
-    if (m_currentTreeType == "BST") {
-        if (m_bst->root) {
-            int treeHeight = m_bst->getHeight(m_bst->root);
-            double initialOffset = std::pow(2, treeHeight - 1) * 50;
-            buildTreeStructure(m_bst->root, result, 0, 400, initialOffset);
-        }
+void TreeManager::exportTree(const QString& filename)
+{
+    submit([this, filename] { saveToFile(filename); });
+}
+
+// When threaded, only the file's existence is checked before returning
+bool TreeManager::importTree(const QString& filename)
+{
+    if (!QFile::exists(filename)) return false;
+    if (!m_worker) return importFile(filename);
+
+    submit([this, filename] { importFile(filename); });
+    return true;
+}
+
+bool TreeManager::importFile(const QString& filename)
+{
+    restoreEditable();
+    TreeStats before = currentStats();
+    std::string file = filename.toStdString();
+    bool binary = filename.endsWith(".bin");
+    bool ok = true;
+    if (m_treeType == "BST") {
+        if (binary) ok = m_bst->loadBinary(file);
+        else m_bst->loadFromFile(file);
     }
-    else if (m_currentTreeType == "AVL") {
-        if (m_avl->root) {
-            int treeHeight = m_avl->getHeight(m_avl->root);
-            double initialOffset = std::pow(2, treeHeight - 1) * 50;
-            buildTreeStructure(m_avl->root, result, 0, 400, initialOffset);
-        }
+    else if (m_treeType == "AVL") {
+        if (binary) ok = m_avl->loadBinary(file);
+        else m_avl->loadFromFile(file);
     }
-    else if (m_currentTreeType == "RB") {
-        if (m_rbTree->root) {
-            int treeHeight = m_rbTree->getHeight(m_rbTree->root);
-            double initialOffset = std::pow(2, treeHeight - 1) * 50;
-            buildRBTreeStructure(m_rbTree->root, result, 0, 400, initialOffset);
-        }
+    else if (m_treeType == "RB") {
+        if (binary) ok = m_rbTree->loadBinary(file);
+        else m_rbTree->loadFromFile(file);
+    }
+    if (!ok) {
+        publishStats(before);
+        return false;
     }
 
-    return result;
+    // A file can hold any shape, so the new version is a copy of it
+    if (m_treeType == "AVL") m_avlHistory.commit(m_avlVersions.capture(m_avl->root));
+    else if (m_treeType == "RB") m_rbHistory.commit(m_rbVersions.capture(m_rbTree->root));
+
+    checkpoint();
+    publishChanges();
+    publishStats(before);
+    publishHistory();
+    notify([this] { emit treeUpdated(); });
+    return true;
+}
+
+// Undo and redo step from wherever the worker is, not from what this thread
+// saw last, so commands queued behind each other add up.
+void TreeManager::undo()
+{
+    submit([this] {
+        if (VersionHistory* history = currentHistory()) checkoutVersion(history->currentIndex() - 1);
+    });
+}
+
+void TreeManager::redo()
+{
+    submit([this] {
+        if (VersionHistory* history = currentHistory()) checkoutVersion(history->currentIndex() + 1);
+    });
+}
+
+void TreeManager::checkout(int version)
+{
+    submit([this, version] { checkoutVersion(version); });
+}
+
+// Moving between versions costs nothing, and so does showing one: the
+// layout and reader threads take the version as it is. The editable tree
+// is only rebuilt by the next operation that needs it (restoreEditable).
+// The journal gets the keys the move deleted and inserted, found by
+// comparing the two versions; when they do not fit below the checkpoint
+// interval, the snapshot is rewritten right away instead.
+void TreeManager::checkoutVersion(int version)
+{
+    VersionHistory* history = currentHistory();
+    if (!history || version == history->currentIndex()) return;
+    const VersionNode* from = history->current();
+    if (!history->checkout(version)) return;
+
+    TreeStats before = currentStats();
+    if (m_treeType == "AVL") m_avlStale = true;
+    else m_rbStale = true;
+
+    std::vector<int> removed, added;
+    PersistentTree::diff(from, history->current(), removed, added);
+    OperationLog& log = currentLog();
+    if (log.size() + static_cast<int>(removed.size() + added.size()) >= CheckpointInterval) {
+        checkpoint();
+    }
+    else {
+        for (int k : removed) log.append(OperationLog::Delete, k);
+        for (int k : added) log.append(OperationLog::Insert, k);
+    }
+
+    publishChanges({ TreeChange{ TreeChange::Reset, 0, 0 } });
+    publishStats(before);
+    publishHistory();
+    notify([this] { emit treeUpdated(); });
+}
+
+VersionHistory* TreeManager::currentHistory()
+{
+    if (m_treeType == "AVL") return &m_avlHistory;
+    if (m_treeType == "RB") return &m_rbHistory;
+    return nullptr;
+}
+
+PublishedTree* TreeManager::published(const QString& type)
+{
+    if (type == "AVL") return &m_avlPublished;
+    if (type == "RB") return &m_rbPublished;
+    return nullptr;
+}
+
+// Rebuilds the current tree from its version after a checkout, in the
+// version's exact shape and in one pass like a snapshot load. What the
+// rebuild records is dropped, since views already show that version.
+void TreeManager::restoreEditable()
+{
+    if (m_treeType == "AVL" && m_avlStale) {
+        m_avlVersions.restore(m_avlHistory.current(), *m_avl);
+        m_avl->changes.take();
+        m_avlStale = false;
+    }
+    else if (m_treeType == "RB" && m_rbStale) {
+        m_rbVersions.restore(m_rbHistory.current(), *m_rbTree);
+        m_rbTree->changes.take();
+        m_rbStale = false;
+    }
 }
 
+// Also where reader threads get to see the new version
+void TreeManager::publishHistory()
+{
+    VersionHistory* history = currentHistory();
+    if (history) published(m_treeType)->publish(history->current());
+    int index = history ? history->currentIndex() : 0;
+    int count = history ? history->count() : 0;
+    notify([this, index, count] {
+        m_versionIndex = index;
+        m_versionCount = count;
+        emit historyChanged();
+    });
+}
+
+// Files ending in .bin use the binary snapshot format, anything else the
+// preorder text format.
 void TreeManager::saveToFile(const QString& filename)
 {
-    if (m_currentTreeType == "BST") {
-        m_bst->saveToFile(filename.toStdString());
+    restoreEditable();
+    std::string file = filename.toStdString();
+    bool binary = filename.endsWith(".bin");
+    if (m_treeType == "BST") {
+        if (binary) m_bst->saveBinary(file);
+        else m_bst->saveToFile(file);
     }
-    else if (m_currentTreeType == "AVL") {
-        m_avl->saveToFile(filename.toStdString());
+    else if (m_treeType == "AVL") {
+        if (binary) m_avl->saveBinary(file);
+        else m_avl->saveToFile(file);
     }
-    else if (m_currentTreeType == "RB") {
-        m_rbTree->saveToFile(filename.toStdString());
+    else if (m_treeType == "RB") {
+        if (binary) m_rbTree->saveBinary(file);
+        else m_rbTree->saveToFile(file);
     }
 }
 
 void TreeManager::loadFromFile(const QString& filename)
 {
-    QFile file(filename);
-    if (!file.exists()) return;
+    // Fall back to the text snapshot written by older versions
+    QString path = filename;
+    if (path.endsWith(".bin") && !QFile::exists(path)) {
+        path.chop(4);
+        path += ".txt";
+    }
+    if (!QFile::exists(path)) return;
 
+    std::string file = path.toStdString();
+    bool binary = path.endsWith(".bin");
     if (filename.contains("bst")) {
-        m_bst->loadFromFile(filename.toStdString());
+        if (binary) m_bst->loadBinary(file);
+        else m_bst->loadFromFile(file);
     }
     else if (filename.contains("avl")) {
-        m_avl->loadFromFile(filename.toStdString());
+        if (binary) m_avl->loadBinary(file);
+        else m_avl->loadFromFile(file);
     }
     else if (filename.contains("rb")) {
-        m_rbTree->loadFromFile(filename.toStdString());
+        if (binary) m_rbTree->loadBinary(file);
+        else m_rbTree->loadFromFile(file);
+    }
+}
+
+OperationLog& TreeManager::currentLog()
+{
+    if (m_treeType == "AVL") return m_avlLog;
+    if (m_treeType == "RB") return m_rbLog;
+    return m_bstLog;
+}
+
+void TreeManager::logOperation(char op, int key)
+{
+    OperationLog& log = currentLog();
+    log.append(op, key);
+    if (log.size() >= CheckpointInterval)
+        checkpoint();
+}
+
+void TreeManager::checkpoint()
+{
+    if (m_treeType == "BST") {
+        saveToFile("bst.bin");
+    }
+    else if (m_treeType == "AVL") {
+        saveToFile("avl.bin");
+    }
+    else if (m_treeType == "RB") {
+        saveToFile("rb.bin");
     }
+    currentLog().truncate();
 }
\ No newline at end of file
@@ -2,17 +2,51 @@
 #define TREEMANAGER_H
 
 #include <QObject>
+#include <QByteArray>
+#include <QFuture>
+#include <QList>
 #include <QVariantList>
 #include <QVariantMap>
 #include <QString>
+#include <functional>
+#include <vector>
 #include "BST.h"
 #include "AVL.h"
 #include "RBTree.h"
+#include "OperationLog.h"
+#include "PersistentTree.h"
+#include "PublishedTree.h"
+#include "TreeLayout.h"
 
+class TreeWorker;
+
+// Owns the three trees and exposes them to QML.
+//
+// In threaded mode a worker thread owns the trees instead: mutations are
+// queued to it and return at once, and the signals they cause arrive later
+// on this object's thread. Whenever the worker's queue runs dry it builds a
+// fresh layout of the current tree and hands it over; queries and layout
+// exports are answered from that snapshot, so the GUI thread never waits
+// for tree work.
 class TreeManager : public QObject
 {
     Q_OBJECT
         Q_PROPERTY(QString currentTreeType READ currentTreeType NOTIFY currentTreeTypeChanged)
+        Q_PROPERTY(bool threaded READ threaded WRITE setThreaded NOTIFY threadedChanged)
+        Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
+        Q_PROPERTY(bool statsEnabled READ statsEnabled CONSTANT)
+        Q_PROPERTY(double comparisons READ comparisons NOTIFY statsChanged)
+        Q_PROPERTY(double rotations READ rotations NOTIFY statsChanged)
+        Q_PROPERTY(double recolorings READ recolorings NOTIFY statsChanged)
+        Q_PROPERTY(double allocations READ allocations NOTIFY statsChanged)
+        Q_PROPERTY(double nodesVisited READ nodesVisited NOTIFY statsChanged)
+        Q_PROPERTY(int treeHeight READ treeHeight NOTIFY statsChanged)
+        Q_PROPERTY(int treeSize READ treeSize NOTIFY statsChanged)
+        Q_PROPERTY(double averageDepth READ averageDepth NOTIFY statsChanged)
+        Q_PROPERTY(int version READ version NOTIFY historyChanged)
+        Q_PROPERTY(int versionCount READ versionCount NOTIFY historyChanged)
+        Q_PROPERTY(bool canUndo READ canUndo NOTIFY historyChanged)
+        Q_PROPERTY(bool canRedo READ canRedo NOTIFY historyChanged)
 
 public:
     explicit TreeManager(QObject* parent = nullptr);
@@ -20,35 +54,166 @@ public:
 
     QString currentTreeType() const { return m_currentTreeType; }
 
+    bool threaded() const { return m_worker != nullptr; }
+    void setThreaded(bool threaded);
+    // True while queued commands have not been applied yet
+    bool busy() const { return m_pendingCommands > 0; }
+
+    // Counters of the last insert, delete, search, update, clear or import;
+    // they stay at zero in builds without BINARYST_STATS. Doubles, since
+    // QML numbers cannot hold a 64-bit count exactly anyway.
+    bool statsEnabled() const;
+    double comparisons() const { return double(m_lastStats.comparisons); }
+    double rotations() const { return double(m_lastStats.rotations); }
+    double recolorings() const { return double(m_lastStats.recolorings); }
+    double allocations() const { return double(m_lastStats.allocations); }
+    double nodesVisited() const { return double(m_lastStats.visited); }
+    // Shape of the current tree, from the layout; height counts levels
+    int treeHeight();
+    int treeSize();
+    double averageDepth();
+
+    // Undo history of the current tree. AVL and RB keep every version as a
+    // persistent tree sharing structure with its neighbours; BST has none,
+    // since its paths, and so each version, can be O(n) long.
+    int version() const { return m_versionIndex; }
+    int versionCount() const { return m_versionCount; }
+    bool canUndo() const { return m_versionIndex > 0; }
+    bool canRedo() const { return m_versionIndex + 1 < m_versionCount; }
+
+    // Latest "AVL" or "RB" version for reader threads, which can search and
+    // traverse it without locks while commands keep changing the tree;
+    // nullptr for "BST". Each reader thread uses its own PublishedTree::Reader.
+    PublishedTree* published(const QString& type);
+
+    // Finishes once every command issued so far has been applied and its
+    // signals delivered; already finished when not threaded.
+    QFuture<void> settled();
+
+    // Layout of the current tree for C++ views; valid until the next treeUpdated
+    const TreeLayout& layout();
+    // Type of the tree the layout was built from; trails currentTreeType
+    // until the worker hands over a layout of the new tree
+    QString layoutTreeType() const { return m_layoutTreeType; }
+
     Q_INVOKABLE void setTreeType(const QString& type);
     Q_INVOKABLE void insertNode(int key);
+    Q_INVOKABLE void tryInsert(int key);
+    Q_INVOKABLE void insertBatch(const QList<int>& keys);
     Q_INVOKABLE void deleteNode(int key);
     Q_INVOKABLE bool searchNode(int key);
     Q_INVOKABLE QVariantList getInorderTraversal();
     Q_INVOKABLE QVariantList getPreorderTraversal();
     Q_INVOKABLE QVariantList getPostorderTraversal();
     Q_INVOKABLE void clearTree();
+    Q_INVOKABLE int size();
+    Q_INVOKABLE int rank(int key);
+    Q_INVOKABLE QVariant select(int k);
+    Q_INVOKABLE QVariantList rangeKeys(int lo, int hi);
+    Q_INVOKABLE int rangeCount(int lo, int hi);
     Q_INVOKABLE QVariantList getTreeStructure();
-    Q_INVOKABLE bool updateNode(int oldValue, int occurrenceIndex, int newValue, const QString& mode = "any");
+    Q_INVOKABLE QVariantMap getTreeLayout();
+    Q_INVOKABLE QByteArray getPackedTreeLayout();
+    Q_INVOKABLE void updateNode(int oldValue, int occurrenceIndex, int newValue, const QString& mode = "any");
+    Q_INVOKABLE void exportTree(const QString& filename);
+    Q_INVOKABLE bool importTree(const QString& filename);
+    Q_INVOKABLE void undo();
+    Q_INVOKABLE void redo();
+    Q_INVOKABLE void checkout(int version);
 
 signals:
     void currentTreeTypeChanged();
+    // What the last operation changed, as flat (kind, key, other) triples;
+    // see TreeChange for the kinds. Emitted before treeUpdated.
+    void treeChanged(const QVariantList& changes);
     void treeUpdated();
     void nodeInserted(int key);
     void nodeDeleted(int key);
+    void nodeUpdated(int oldKey, int newKey);
+    // Outcome of each tryInsert/insertNode and updateNode, once applied.
+    // depth is that of the new node or of the existing duplicate.
+    void insertFinished(int key, bool inserted, int depth);
+    void updateFinished(int oldValue, int newValue, bool updated);
     void treeCleared();
+    void threadedChanged();
+    void busyChanged();
+    void statsChanged();
+    void historyChanged();
 
 private:
     BST* m_bst;
     AVL* m_avl;
     RBTree* m_rbTree;
     QString m_currentTreeType;
+    QString m_treeType;     // the tree commands act on; trails m_currentTreeType while queued
+
+    TreeWorker* m_worker;
+    int m_pendingCommands;
+    // Worker side: what the commands since the last snapshot produced
+    ChangeList m_batchChanges;
+    std::vector<std::function<void()>> m_outbox;
+    int m_batchCommands;
+
+    TreeStats m_lastStats;
 
-    void buildTreeStructure(BSTNode* node, QVariantList& list, int level, double x, double xOffset);
-    void buildRBTreeStructure(RBNode* node, QVariantList& list, int level, double x, double xOffset);
+    OperationLog m_bstLog;
+    OperationLog m_avlLog;
+    OperationLog m_rbLog;
+
+    PersistentAVL m_avlVersions;
+    PersistentRB m_rbVersions;
+    VersionHistory m_avlHistory;
+    VersionHistory m_rbHistory;
+    // Set by a checkout: the editable tree still holds the version before
+    // it and is rebuilt from the current one once it is needed
+    bool m_avlStale;
+    bool m_rbStale;
+    PublishedTree m_avlPublished;
+    PublishedTree m_rbPublished;
+    // This thread's view of the current tree's history
+    int m_versionIndex;
+    int m_versionCount;
+
+    // Layout of the current tree, patched or rebuilt lazily after changes
+    TreeLayout m_layout;
+    QString m_layoutTreeType;
+    QVariantMap m_layoutCache;
+    QByteArray m_packedLayout;
+    bool m_layoutValid;
+
+    void invalidateLayout();
+    void ensureLayout();
+    void buildLayout(TreeLayout& out) const;
+    void applyToLayout(const std::vector<TreeChange>& changes);
+    void publishChanges();
+    void publishChanges(const std::vector<TreeChange>& changes);
+
+    TreeStats currentStats() const;
+    void publishStats(const TreeStats& before);
+
+    void submit(std::function<void()> command);
+    void notify(std::function<void()> signal);
+    void flushBatch();
+
+    void insertKey(int key);
+    void insertKeys(std::vector<int> keys);
+    void removeKey(int key);
+    void clearCurrent();
+    bool replaceKey(int target, int newValue);
+    void updateKey(int oldValue, int occurrenceIndex, int newValue, const QString& mode);
+    bool importFile(const QString& filename);
+    void checkoutVersion(int version);
+
+    VersionHistory* currentHistory();
+    void publishHistory();
+    void restoreEditable();
 
     void saveToFile(const QString& filename);
     void loadFromFile(const QString& filename);
+
+    OperationLog& currentLog();
+    void logOperation(char op, int key = 0);
+    void checkpoint();
 };
 
 #endif // TREEMANAGER_H
\ No newline at end of file
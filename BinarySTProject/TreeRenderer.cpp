@@ -0,0 +1,720 @@
+#include "TreeRenderer.h"
+#include <QQuickWindow>
+#include <QVariantAnimation>
+#include <QEasingCurve>
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QSGTextureMaterial>
+#include <QSGTexture>
+#include <QSGRenderNode>
+#include <QSGRendererInterface>
+#include <QPainter>
+#include <QPixmap>
+#include <QRegion>
+#include <QFont>
+#include <QFontMetricsF>
+#include <QRadialGradient>
+#include <QLineF>
+#include <QPen>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Nodes per geometry chunk. A chunk is the unit that gets re-uploaded.
+static const int ChunkSize = 4096;
+static const float EdgeWidth = 3.0f;
+static const int SpriteSize = 2 * TreeRenderer::NodeRadius + 8;
+static const int MorphDuration = 350;
+
+static QColor edgeColor() { return QColor(0x00, 0x33, 0x66); }
+static QColor blobColor() { return QColor(0x2d, 0xae, 0xe6, 0x60); }
+
+// Characters in the glyph cache, in Atlas::glyph order
+static const char GlyphChars[] = "0123456789-.[]";
+
+static int glyphIndex(QChar c)
+{
+    if (c.isDigit()) return c.digitValue();
+    const char* p = std::strchr(GlyphChars + 10, c.toLatin1());
+    return p && *p ? int(p - GlyphChars) : 10;
+}
+
+const TreeRenderer::Atlas& TreeRenderer::atlas()
+{
+    static const Atlas cached = [] {
+        Atlas a;
+        QFont font(QStringLiteral("Segoe UI"));
+        font.setBold(true);
+        font.setPixelSize(16);
+        QFontMetricsF fm(font);
+        const QString chars = QString::fromLatin1(GlyphChars);
+
+        int glyphRowWidth = 0;
+        for (QChar c : chars)
+            glyphRowWidth += int(std::ceil(fm.horizontalAdvance(c))) + 2;
+        int glyphHeight = int(std::ceil(fm.height()));
+
+        a.image = QImage(qMax(3 * SpriteSize, glyphRowWidth), SpriteSize + glyphHeight,
+            QImage::Format_ARGB32_Premultiplied);
+        a.image.fill(Qt::transparent);
+
+        QPainter p(&a.image);
+        p.setRenderHint(QPainter::Antialiasing);
+
+        // Same gradients the canvas used: blue for BST/AVL, red and black for RB
+        const QColor inner[3] = { QColor("#88aaff"), QColor("#ff8a80"), QColor("#b0b0b0") };
+        const QColor outer[3] = { QColor("#0984E3"), QColor("#ef4444"), QColor("#2d3436") };
+        for (int i = 0; i < 3; ++i) {
+            QPointF center(i * SpriteSize + SpriteSize / 2.0, SpriteSize / 2.0);
+            QRadialGradient gradient(center, NodeRadius);
+            gradient.setColorAt(0, inner[i]);
+            gradient.setColorAt(1, outer[i]);
+            p.setBrush(gradient);
+            p.setPen(QPen(Qt::white, 3));
+            p.drawEllipse(center, NodeRadius, NodeRadius);
+            a.sprite[i] = QRectF(i * SpriteSize, 0, SpriteSize, SpriteSize);
+        }
+
+        // Glyph cells are one pixel wider on each side so filtering never
+        // picks up a neighbour
+        p.setFont(font);
+        p.setPen(Qt::white);
+        int x = 0;
+        for (QChar c : chars) {
+            int g = glyphIndex(c);
+            int w = int(std::ceil(fm.horizontalAdvance(c))) + 2;
+            p.drawText(QPointF(x + 1, SpriteSize + fm.ascent()), QString(c));
+            a.glyph[g] = QRectF(x, SpriteSize, w, glyphHeight);
+            a.advance[g] = fm.horizontalAdvance(c);
+            x += w;
+        }
+        a.glyphHeight = glyphHeight;
+        return a;
+    }();
+    return cached;
+}
+
+static qreal labelWidth(const QString& label)
+{
+    const TreeRenderer::Atlas& a = TreeRenderer::atlas();
+    qreal width = 0;
+    for (QChar c : label)
+        width += a.advance[glyphIndex(c)];
+    return width;
+}
+
+// Calls out(target, source) for every glyph of a label centered at
+// (cx, cy) and drawn `scale` times its cached size.
+template <typename Out>
+static void labelQuads(double cx, double cy, const QString& label, qreal scale, Out out)
+{
+    const TreeRenderer::Atlas& a = TreeRenderer::atlas();
+    qreal pen = cx - labelWidth(label) * scale / 2;
+    qreal top = cy - a.glyphHeight * scale / 2;
+    for (QChar c : label) {
+        int g = glyphIndex(c);
+        out(QRectF(pen - scale, top, a.glyph[g].width() * scale, a.glyphHeight * scale), a.glyph[g]);
+        pen += a.advance[g] * scale;
+    }
+}
+
+// Calls out(target, source) for the node sprite and then for every glyph
+// of the key label, all in item coordinates / atlas pixels.
+template <typename Out>
+static void nodeQuads(double cx, double cy, int key, int color, Out out)
+{
+    const TreeRenderer::Atlas& a = TreeRenderer::atlas();
+    const qreal half = SpriteSize / 2.0;
+    out(QRectF(cx - half, cy - half, SpriteSize, SpriteSize), a.sprite[color]);
+    labelQuads(cx, cy, QString::number(key), 1, out);
+}
+
+static int labelLength(int key)
+{
+    int n = key < 0 ? 2 : 1;
+    for (long long k = key < 0 ? -(long long)key : key; k >= 10; k /= 10)
+        ++n;
+    return n;
+}
+
+static quint64 hashBytes(quint64 h, const void* data, size_t len)
+{
+    // FNV-1a
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+namespace {
+
+struct Chunk {
+    quint64 hash;
+    QSGGeometryNode* edges;
+    QSGGeometryNode* sprites;
+};
+
+// Root of the hardware path. Edges of all chunks sit under edgeLayer and
+// are therefore drawn below collapsed subtrees, which are drawn below every
+// node sprite and finally the labels of the collapsed subtrees.
+class TreeRootNode : public QSGNode
+{
+public:
+    QSGTexture* texture;
+    QSGNode* edgeLayer;
+    QSGGeometryNode* blobs;
+    QSGNode* spriteLayer;
+    QSGGeometryNode* blobLabels;
+    std::vector<Chunk> chunks;
+
+    TreeRootNode(QSGTexture* t, QSGGeometryNode* blobNode, QSGGeometryNode* blobLabelNode)
+        : texture(t), edgeLayer(new QSGNode), blobs(blobNode), spriteLayer(new QSGNode), blobLabels(blobLabelNode) {
+        appendChildNode(edgeLayer);
+        appendChildNode(blobs);
+        appendChildNode(spriteLayer);
+        appendChildNode(blobLabels);
+    }
+    ~TreeRootNode() override {
+        delete texture;
+    }
+};
+
+// Software backend: the same batches, replayed through the scene graph's QPainter
+class SoftwareTreeNode : public QSGRenderNode
+{
+public:
+    QQuickWindow* window;
+    QRectF bounds;
+    QVector<QLineF> edges;
+    QVector<QPointF> blobs;    // three corners per collapsed subtree
+    QVector<QPainter::PixmapFragment> fragments;
+    QVector<QPainter::PixmapFragment> blobLabels;
+    QPixmap pixmap;
+
+    explicit SoftwareTreeNode(QQuickWindow* w) : window(w) {}
+
+    void render(const RenderState* state) override {
+        QSGRendererInterface* rif = window->rendererInterface();
+        QPainter* painter = static_cast<QPainter*>(
+            rif->getResource(window, QSGRendererInterface::PainterResource));
+        if (!painter) return;
+        if (pixmap.isNull())
+            pixmap = QPixmap::fromImage(TreeRenderer::atlas().image);
+
+        painter->setTransform(matrix()->toTransform());
+        painter->setOpacity(inheritedOpacity());
+        const QRegion* clip = state->clipRegion();
+        if (clip && !clip->isEmpty())
+            painter->setClipRegion(*clip, Qt::ReplaceClip);
+
+        painter->setRenderHint(QPainter::Antialiasing);
+        painter->setPen(QPen(edgeColor(), EdgeWidth));
+        painter->drawLines(edges.constData(), int(edges.size()));
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(blobColor());
+        for (int i = 0; i + 2 < blobs.size(); i += 3)
+            painter->drawPolygon(blobs.constData() + i, 3);
+        painter->drawPixmapFragments(fragments.constData(), int(fragments.size()), pixmap);
+        painter->drawPixmapFragments(blobLabels.constData(), int(blobLabels.size()), pixmap);
+    }
+    StateFlags changedStates() const override { return {}; }
+    RenderingFlags flags() const override { return BoundedRectRendering; }
+    QRectF rect() const override { return bounds; }
+};
+
+}
+
+static QSGGeometryNode* newEdgeNode()
+{
+    QSGGeometryNode* node = new QSGGeometryNode;
+    QSGGeometry* geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+    geometry->setDrawingMode(QSGGeometry::DrawTriangles);
+    node->setGeometry(geometry);
+    node->setFlag(QSGNode::OwnsGeometry);
+    QSGFlatColorMaterial* material = new QSGFlatColorMaterial;
+    material->setColor(edgeColor());
+    node->setMaterial(material);
+    node->setFlag(QSGNode::OwnsMaterial);
+    return node;
+}
+
+static QSGGeometryNode* newBlobNode()
+{
+    QSGGeometryNode* node = newEdgeNode();
+    static_cast<QSGFlatColorMaterial*>(node->material())->setColor(blobColor());
+    return node;
+}
+
+static QSGGeometryNode* newSpriteNode(QSGTexture* texture)
+{
+    QSGGeometryNode* node = new QSGGeometryNode;
+    QSGGeometry* geometry = new QSGGeometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 0);
+    geometry->setDrawingMode(QSGGeometry::DrawTriangles);
+    node->setGeometry(geometry);
+    node->setFlag(QSGNode::OwnsGeometry);
+    QSGTextureMaterial* material = new QSGTextureMaterial;
+    material->setTexture(texture);
+    material->setFiltering(QSGTexture::Linear);
+    material->setFlag(QSGMaterial::Blending);
+    node->setMaterial(material);
+    node->setFlag(QSGNode::OwnsMaterial);
+    return node;
+}
+
+// Two triangles covering a line of EdgeWidth from (x0, y0) to (x1, y1)
+static void setEdgeQuad(QSGGeometry::Point2D* v, float x0, float y0, float x1, float y1)
+{
+    float dx = x1 - x0, dy = y1 - y0;
+    float len = std::sqrt(dx * dx + dy * dy);
+    float nx = 0, ny = 0;
+    if (len > 0) {
+        nx = -dy / len * EdgeWidth / 2;
+        ny = dx / len * EdgeWidth / 2;
+    }
+    v[0].set(x0 + nx, y0 + ny);
+    v[1].set(x1 + nx, y1 + ny);
+    v[2].set(x0 - nx, y0 - ny);
+    v[3].set(x1 + nx, y1 + ny);
+    v[4].set(x1 - nx, y1 - ny);
+    v[5].set(x0 - nx, y0 - ny);
+}
+
+static void setTexturedQuad(QSGGeometry::TexturedPoint2D* v, const QRectF& r, const QRectF& src, const QSize& atlasSize)
+{
+    float l = float(r.left()), t = float(r.top()), rt = float(r.right()), b = float(r.bottom());
+    float sl = float(src.left() / atlasSize.width()), st = float(src.top() / atlasSize.height());
+    float sr = float(src.right() / atlasSize.width()), sb = float(src.bottom() / atlasSize.height());
+    v[0].set(l, t, sl, st);
+    v[1].set(rt, t, sr, st);
+    v[2].set(l, b, sl, sb);
+    v[3].set(rt, t, sr, st);
+    v[4].set(rt, b, sr, sb);
+    v[5].set(l, b, sl, sb);
+}
+
+TreeRenderer::TreeRenderer(QQuickItem* parent)
+    : QQuickItem(parent)
+    , m_morph(new QVariantAnimation(this))
+    , m_morphProgress(1)
+    , m_redBlack(false)
+    , m_dataChanged(true)
+    , m_zoom(1)
+    , m_lodThreshold(0.5)
+{
+    setFlag(ItemHasContents, true);
+
+    m_morph->setDuration(MorphDuration);
+    m_morph->setEasingCurve(QEasingCurve::OutCubic);
+    m_morph->setStartValue(0.0);
+    m_morph->setEndValue(1.0);
+    connect(m_morph, &QVariantAnimation::valueChanged, this, [this](const QVariant& value) {
+        m_morphProgress = value.toReal();
+        m_dataChanged = true;
+        update();
+    });
+}
+
+void TreeRenderer::setManager(TreeManager* manager)
+{
+    if (m_manager == manager) return;
+    if (m_manager) disconnect(m_manager, nullptr, this, nullptr);
+    m_manager = manager;
+    if (m_manager) connect(m_manager, &TreeManager::treeChanged, this, &TreeRenderer::applyChanges);
+    m_morph->stop();
+    m_morphProgress = 1;
+    reload();
+    emit managerChanged();
+}
+
+// A viewport that stays inside the area queried for the current geometry
+// needs no new geometry; the scene graph transform takes care of scrolling.
+void TreeRenderer::setViewport(const QRectF& viewport)
+{
+    if (m_viewport == viewport) return;
+    m_viewport = viewport;
+    if (!m_queried.contains(viewport) || viewport.isEmpty()) {
+        m_dataChanged = true;
+        update();
+    }
+    emit viewportChanged();
+}
+
+// Collapsing depends on the zoom, so while the detail level is reduced (or
+// about to change) every zoom step rebuilds the geometry.
+void TreeRenderer::setZoom(qreal zoom)
+{
+    if (m_zoom == zoom) return;
+    bool wasActive = lodActive();
+    m_zoom = zoom;
+    if (wasActive || lodActive()) {
+        m_dataChanged = true;
+        update();
+    }
+    emit zoomChanged();
+}
+
+void TreeRenderer::setLodThreshold(qreal threshold)
+{
+    if (m_lodThreshold == threshold) return;
+    m_lodThreshold = threshold;
+    m_dataChanged = true;
+    update();
+    emit lodThresholdChanged();
+}
+
+// Copies the manager's layout so the render thread never touches the trees
+void TreeRenderer::reload()
+{
+    if (m_manager) {
+        m_layout = m_manager->layout();
+        m_redBlack = m_manager->layoutTreeType() == "RB";
+    }
+    else {
+        m_layout.clear();
+    }
+
+    if (m_layout.count() > 0)
+        setImplicitSize(m_layout.width + 2 * Padding, m_layout.height + 2 * Padding);
+    else
+        setImplicitSize(0, 0);
+    m_dataChanged = true;
+    update();
+    emit contentChanged();
+}
+
+// Recolors and rekeys leave every position where it is, so they are patched
+// in place and the chunk hashes limit the upload to the chunks they touch.
+// Anything else reloads the layout and, unless the tree was replaced
+// wholesale, morphs from the previous one.
+void TreeRenderer::applyChanges(const QVariantList& changes)
+{
+    bool structural = false;
+    bool reset = false;
+    for (int i = 0; i + 2 < changes.size(); i += 3) {
+        int kind = changes[i].toInt();
+        if (kind == TreeChange::Reset) reset = true;
+        else if (kind != TreeChange::Recolored && kind != TreeChange::Rekeyed) structural = true;
+    }
+
+    if (!structural && !reset) {
+        for (int i = 0; i + 2 < changes.size(); i += 3) {
+            int key = changes[i + 1].toInt();
+            int other = changes[i + 2].toInt();
+            if (changes[i].toInt() == TreeChange::Recolored) m_layout.setRed(key, other != 0);
+            else m_layout.rekey(key, other);
+        }
+        m_dataChanged = true;
+        update();
+        return;
+    }
+
+    m_morph->stop();
+    if (reset || m_layout.count() == 0) {
+        m_previous.clear();
+        m_morphProgress = 1;
+        reload();
+        return;
+    }
+    m_previous = m_layout;
+    m_morphProgress = 0;
+    reload();
+    m_morph->start();
+}
+
+// Where node i is drawn relative to the layout origin. New nodes appear at
+// their final place; the others follow their key from the old layout.
+QPointF TreeRenderer::nodePoint(int i) const
+{
+    QPointF to(m_layout.x[i], m_layout.y[i]);
+    if (m_morphProgress >= 1) return to;
+    int j = m_previous.find(m_layout.keys[i]);
+    if (j < 0) return to;
+    QPointF from(m_previous.x[j], m_previous.y[j]);
+    return from + (to - from) * m_morphProgress;
+}
+
+QVariant TreeRenderer::nodePosition(int key) const
+{
+    int i = m_layout.find(key);
+    if (i < 0) return QVariant();
+    return QPointF(Padding + m_layout.x[i], Padding + m_layout.y[i]);
+}
+
+// Picks the nodes, edges and collapsed subtrees to draw: those near the
+// viewport, or all of them when no viewport is set. The queried area is the
+// viewport grown by half its size on every side, so small scrolls reuse the
+// geometry.
+void TreeRenderer::collectVisible()
+{
+    const TreeLayout& l = m_layout;
+    int n = l.count();
+    m_visibleBlobs.clear();
+
+    m_queried = QRectF();
+    if (!m_viewport.isEmpty()) {
+        qreal dx = m_viewport.width() / 2, dy = m_viewport.height() / 2;
+        m_queried = m_viewport.adjusted(-dx, -dy, dx, dy);
+    }
+
+    if (lodActive()) {
+        collectCollapsed();
+        return;
+    }
+
+    if (m_queried.isEmpty()) {
+        m_visibleNodes.resize(n);
+        m_visibleEdges.clear();
+        for (int i = 0; i < n; ++i) {
+            m_visibleNodes[i] = i;
+            if (l.parent[i] >= 0) m_visibleEdges.push_back(i);
+        }
+        return;
+    }
+
+    l.query(m_queried.left() - Padding, m_queried.top() - Padding,
+        m_queried.right() - Padding, m_queried.bottom() - Padding,
+        NodeRadius + 3, m_visibleNodes, m_visibleEdges);
+}
+
+// Walks down from the root, skipping subtrees whose bounding box misses the
+// queried area and collapsing those narrower than CollapsePixels on screen.
+// Every node drawn on its own has a subtree at least that wide, so the
+// output is bounded by what fits on screen plus the path down to it.
+void TreeRenderer::collectCollapsed()
+{
+    const TreeLayout& l = m_layout;
+    m_visibleNodes.clear();
+    m_visibleEdges.clear();
+    if (l.count() == 0) return;
+
+    const double collapseWidth = CollapsePixels / m_zoom;
+    const double r = NodeRadius + 3;
+    auto subtreeBox = [&](int v) {
+        double top = Padding + l.y[v];
+        double bottom = top + l.subtreeHeight[v] * l.levelSeparation;
+        return QRectF(Padding + l.subtreeMinX[v] - r, top - r,
+            l.subtreeMaxX[v] - l.subtreeMinX[v] + 2 * r, bottom - top + 2 * r);
+    };
+    auto edgeBox = [&](int c) {
+        int p = l.parent[c];
+        return QRectF(QPointF(Padding + qMin(l.x[p], l.x[c]), Padding + l.y[p]),
+            QPointF(Padding + qMax(l.x[p], l.x[c]), Padding + l.y[c]));
+    };
+
+    std::vector<int> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        int v = stack.back();
+        stack.pop_back();
+        if (!m_queried.isEmpty() && !m_queried.intersects(subtreeBox(v))) continue;
+
+        if (l.subtreeSize[v] > 1 && l.subtreeMaxX[v] - l.subtreeMinX[v] + 2 * r < collapseWidth) {
+            m_visibleBlobs.push_back(v);
+            continue;
+        }
+
+        m_visibleNodes.push_back(v);
+        for (int c : { l.right[v], l.left[v] }) {
+            if (c < 0) continue;
+            QRectF box = edgeBox(c);
+            if (m_queried.isEmpty() || m_queried.intersects(box.adjusted(-1, -1, 1, 1)))
+                m_visibleEdges.push_back(c);
+            stack.push_back(c);
+        }
+    }
+}
+
+// Calls triangle(apex, left, right) and label(x, y, text, scale) for each
+// collapsed subtree. Labels keep their on-screen size whatever the zoom and
+// are left out when they would not fit inside the triangle.
+template <typename Triangle, typename Label>
+static void blobShapes(const TreeLayout& l, const std::vector<int>& blobs, qreal zoom,
+    Triangle triangle, Label label)
+{
+    const qreal padding = TreeRenderer::Padding;
+    const qreal scale = 1 / zoom;
+    const qreal lineHeight = TreeRenderer::atlas().glyphHeight * scale;
+    for (int v : blobs) {
+        QPointF apex(padding + l.x[v], padding + l.y[v]);
+        qreal base = apex.y() + qMax(1, l.subtreeHeight[v]) * l.levelSeparation;
+        QPointF left(padding + l.subtreeMinX[v], base);
+        QPointF right(padding + l.subtreeMaxX[v], base);
+        triangle(apex, left, right);
+
+        QString size = QString::number(l.subtreeSize[v]);
+        QString range = QStringLiteral("[%1..%2]").arg(l.minKey[v]).arg(l.maxKey[v]);
+        qreal width = qMax(labelWidth(size), labelWidth(range)) * scale;
+        if (width > right.x() - left.x()) continue;
+
+        qreal cx = (left.x() + right.x()) / 2;
+        qreal cy = base - lineHeight * 1.5;
+        label(cx, cy - lineHeight / 2, size, scale);
+        label(cx, cy + lineHeight / 2, range, scale);
+    }
+}
+
+QSGNode* TreeRenderer::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData*)
+{
+    const Atlas& a = atlas();
+    const TreeLayout& l = m_layout;
+    auto nodeX = [&](int i) { return Padding + nodePoint(i).x(); };
+    auto nodeY = [&](int i) { return Padding + nodePoint(i).y(); };
+    auto color = [&](int i) { return m_redBlack ? (l.red[i] ? 1 : 2) : 0; };
+
+    if (window()->rendererInterface()->graphicsApi() == QSGRendererInterface::Software) {
+        SoftwareTreeNode* node = static_cast<SoftwareTreeNode*>(oldNode);
+        if (!node) {
+            node = new SoftwareTreeNode(window());
+            m_dataChanged = true;
+        }
+        if (m_dataChanged) {
+            collectVisible();
+            node->edges.clear();
+            node->fragments.clear();
+            node->edges.reserve(int(m_visibleEdges.size()));
+            for (int i : m_visibleEdges) {
+                int p = l.parent[i];
+                node->edges.append(QLineF(nodeX(p), nodeY(p), nodeX(i), nodeY(i)));
+            }
+            for (int i : m_visibleNodes) {
+                nodeQuads(nodeX(i), nodeY(i), l.keys[i], color(i), [&](const QRectF& r, const QRectF& src) {
+                    node->fragments.append(QPainter::PixmapFragment::create(r.center(), src));
+                });
+            }
+            node->blobs.clear();
+            node->blobLabels.clear();
+            blobShapes(l, m_visibleBlobs, m_zoom,
+                [&](const QPointF& apex, const QPointF& left, const QPointF& right) {
+                    node->blobs << apex << left << right;
+                },
+                [&](qreal x, qreal y, const QString& text, qreal scale) {
+                    labelQuads(x, y, text, scale, [&](const QRectF& r, const QRectF& src) {
+                        node->blobLabels.append(QPainter::PixmapFragment::create(r.center(), src, scale, scale));
+                    });
+                });
+            node->bounds = m_queried.isEmpty() ? QRectF(0, 0, implicitWidth(), implicitHeight()) : m_queried;
+            node->markDirty(QSGNode::DirtyMaterial);
+            m_dataChanged = false;
+        }
+        return node;
+    }
+
+    TreeRootNode* root = static_cast<TreeRootNode*>(oldNode);
+    if (!root) {
+        QSGTexture* texture = window()->createTextureFromImage(a.image, QQuickWindow::TextureHasAlphaChannel);
+        root = new TreeRootNode(texture, newBlobNode(), newSpriteNode(texture));
+        m_dataChanged = true;
+    }
+    if (!m_dataChanged) return root;
+    m_dataChanged = false;
+    collectVisible();
+
+    int nodeCount = int(m_visibleNodes.size());
+    int edgeCount = int(m_visibleEdges.size());
+    size_t chunkCount = size_t((qMax(nodeCount, edgeCount) + ChunkSize - 1) / ChunkSize);
+    while (root->chunks.size() > chunkCount) {
+        Chunk c = root->chunks.back();
+        root->chunks.pop_back();
+        root->edgeLayer->removeChildNode(c.edges);
+        root->spriteLayer->removeChildNode(c.sprites);
+        delete c.edges;
+        delete c.sprites;
+    }
+    while (root->chunks.size() < chunkCount) {
+        Chunk c = { 0, newEdgeNode(), newSpriteNode(root->texture) };
+        root->edgeLayer->appendChildNode(c.edges);
+        root->spriteLayer->appendChildNode(c.sprites);
+        root->chunks.push_back(c);
+    }
+
+    for (size_t ci = 0; ci < chunkCount; ++ci) {
+        int begin = int(ci) * ChunkSize;
+        int nodeEnd = qMin(nodeCount, begin + ChunkSize);
+        int edgeEnd = qMin(edgeCount, begin + ChunkSize);
+
+        // Everything the chunk's vertices depend on
+        quint64 h = 14695981039346656037ULL;
+        int quadCount = 0;
+        for (int k = begin; k < nodeEnd; ++k) {
+            int i = m_visibleNodes[k];
+            QPointF p = nodePoint(i);
+            double pos[2] = { p.x(), p.y() };
+            int c = color(i);
+            h = hashBytes(h, pos, sizeof(pos));
+            h = hashBytes(h, &l.keys[i], sizeof(int));
+            h = hashBytes(h, &c, sizeof(int));
+            quadCount += 1 + labelLength(l.keys[i]);
+        }
+        for (int k = begin; k < edgeEnd; ++k) {
+            int i = m_visibleEdges[k];
+            QPointF child = nodePoint(i), parent = nodePoint(l.parent[i]);
+            double pos[4] = { child.x(), child.y(), parent.x(), parent.y() };
+            h = hashBytes(h, pos, sizeof(pos));
+        }
+        int chunkEdges = qMax(0, edgeEnd - begin);
+
+        Chunk& c = root->chunks[ci];
+        if (c.hash == h && c.edges->geometry()->vertexCount() == chunkEdges * 6) continue;
+        c.hash = h;
+
+        QSGGeometry* eg = c.edges->geometry();
+        eg->allocate(chunkEdges * 6);
+        QSGGeometry::Point2D* ev = eg->vertexDataAsPoint2D();
+        for (int k = begin; k < edgeEnd; ++k) {
+            int i = m_visibleEdges[k];
+            int p = l.parent[i];
+            setEdgeQuad(ev, float(nodeX(p)), float(nodeY(p)), float(nodeX(i)), float(nodeY(i)));
+            ev += 6;
+        }
+        c.edges->markDirty(QSGNode::DirtyGeometry);
+
+        QSGGeometry* sg = c.sprites->geometry();
+        sg->allocate(quadCount * 6);
+        QSGGeometry::TexturedPoint2D* sv = sg->vertexDataAsTexturedPoint2D();
+        const QSize atlasSize = a.image.size();
+        for (int k = begin; k < nodeEnd; ++k) {
+            int i = m_visibleNodes[k];
+            nodeQuads(nodeX(i), nodeY(i), l.keys[i], color(i), [&](const QRectF& r, const QRectF& src) {
+                setTexturedQuad(sv, r, src, atlasSize);
+                sv += 6;
+            });
+        }
+        c.sprites->markDirty(QSGNode::DirtyGeometry);
+    }
+
+    // Collapsed subtrees are few (bounded by the screen), so they are
+    // simply rebuilt every time
+    std::vector<QPointF> corners;
+    std::vector<std::pair<QRectF, QRectF>> labelQuadList;
+    blobShapes(l, m_visibleBlobs, m_zoom,
+        [&](const QPointF& apex, const QPointF& left, const QPointF& right) {
+            corners.push_back(apex);
+            corners.push_back(left);
+            corners.push_back(right);
+        },
+        [&](qreal x, qreal y, const QString& text, qreal scale) {
+            labelQuads(x, y, text, scale, [&](const QRectF& r, const QRectF& src) {
+                labelQuadList.emplace_back(r, src);
+            });
+        });
+
+    QSGGeometry* bg = root->blobs->geometry();
+    bg->allocate(int(corners.size()));
+    QSGGeometry::Point2D* bv = bg->vertexDataAsPoint2D();
+    for (size_t i = 0; i < corners.size(); ++i)
+        bv[i].set(float(corners[i].x()), float(corners[i].y()));
+    root->blobs->markDirty(QSGNode::DirtyGeometry);
+
+    QSGGeometry* lg = root->blobLabels->geometry();
+    lg->allocate(int(labelQuadList.size()) * 6);
+    QSGGeometry::TexturedPoint2D* lv = lg->vertexDataAsTexturedPoint2D();
+    for (const auto& q : labelQuadList) {
+        setTexturedQuad(lv, q.first, q.second, a.image.size());
+        lv += 6;
+    }
+    root->blobLabels->markDirty(QSGNode::DirtyGeometry);
+
+    return root;
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef TREERENDERER_H
+#define TREERENDERER_H
+
+#include <QQuickItem>
+#include <QPointer>
+#include <QVariant>
+#include <QImage>
+#include <QRectF>
+#include <QPointF>
+#include <vector>
+#include "TreeManager.h"
+
+class QVariantAnimation;
+
+// Draws the current tree of a TreeManager straight into the Qt Quick scene
+// graph. Edges and nodes are batched into a few geometry nodes that share
+// one texture atlas holding the node sprites and the glyphs used by key
+// labels. Geometry is split into fixed-size chunks and a chunk is only
+// uploaded again when its contents changed.
+//
+// The software backend cannot draw geometry nodes, so there the same
+// batches are painted through a QPainter render node instead.
+//
+// Below lodThreshold zoom, subtrees narrower than CollapsePixels on screen
+// are drawn as one triangle labeled with their size and key range, so the
+// number of primitives follows the visible screen area, not the tree size.
+//
+// Recolors and in-place key changes are patched into the local layout copy;
+// structural changes reload it and slide every surviving node from its old
+// position to its new one, so rotations are animated.
+//
+// Node i of the layout is drawn centered at (Padding + x, Padding + y) in
+// item coordinates; the implicit size covers the whole tree.
+class TreeRenderer : public QQuickItem
+{
+    Q_OBJECT
+        Q_PROPERTY(TreeManager* manager READ manager WRITE setManager NOTIFY managerChanged)
+        Q_PROPERTY(int nodeCount READ nodeCount NOTIFY contentChanged)
+        Q_PROPERTY(QRectF viewport READ viewport WRITE setViewport NOTIFY viewportChanged)
+        Q_PROPERTY(qreal zoom READ zoom WRITE setZoom NOTIFY zoomChanged)
+        Q_PROPERTY(qreal lodThreshold READ lodThreshold WRITE setLodThreshold NOTIFY lodThresholdChanged)
+
+public:
+    static const int Padding = 40;
+    static const int NodeRadius = 30;
+    static const int CollapsePixels = 120;
+
+    explicit TreeRenderer(QQuickItem* parent = nullptr);
+
+    TreeManager* manager() const { return m_manager; }
+    void setManager(TreeManager* manager);
+    int nodeCount() const { return m_layout.count(); }
+
+    // Visible area in item coordinates. Only nodes and edges near it are
+    // turned into geometry; an empty viewport draws the whole tree.
+    QRectF viewport() const { return m_viewport; }
+    void setViewport(const QRectF& viewport);
+
+    // On-screen scale of the item, used to pick the level of detail
+    qreal zoom() const { return m_zoom; }
+    void setZoom(qreal zoom);
+    qreal lodThreshold() const { return m_lodThreshold; }
+    void setLodThreshold(qreal threshold);
+
+    // Position of a key in item coordinates, or undefined when absent
+    Q_INVOKABLE QVariant nodePosition(int key) const;
+
+    // Sprite per color (blue, red, black) followed by the label glyphs
+    struct Atlas {
+        QImage image;
+        QRectF sprite[3];
+        QRectF glyph[14];   // '0'..'9', then '-', '.', '[', ']'
+        qreal advance[14];
+        qreal glyphHeight;
+    };
+    static const Atlas& atlas();
+
+signals:
+    void managerChanged();
+    void contentChanged();
+    void viewportChanged();
+    void zoomChanged();
+    void lodThresholdChanged();
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+
+private:
+    QPointer<TreeManager> m_manager;
+    TreeLayout m_layout;
+    TreeLayout m_previous;   // layout before the last structural change
+    QVariantAnimation* m_morph;
+    qreal m_morphProgress;   // 0 at m_previous, 1 at m_layout
+    bool m_redBlack;
+    bool m_dataChanged;
+
+    QRectF m_viewport;
+    qreal m_zoom;
+    qreal m_lodThreshold;
+    QRectF m_queried;   // area the current geometry covers, empty for all
+    std::vector<int> m_visibleNodes;
+    std::vector<int> m_visibleEdges;
+    std::vector<int> m_visibleBlobs;   // roots of collapsed subtrees
+
+    bool lodActive() const { return m_zoom < m_lodThreshold; }
+    QPointF nodePoint(int i) const;
+
+    void collectVisible();
+    void collectCollapsed();
+    void reload();
+    void applyChanges(const QVariantList& changes);
+};
+
+#endif // TREERENDERER_H
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+// Running operation counters of one tree. The trees bump them through
+// TREE_STAT, which only does something when BINARYST_STATS is defined, so
+// builds without it carry the (zero) fields but no counting code.
+struct TreeStats {
+    unsigned long long comparisons = 0;  // three-way key comparisons on the way down
+    unsigned long long rotations = 0;
+    unsigned long long recolorings = 0;
+    unsigned long long allocations = 0;  // nodes taken from the pool
+    unsigned long long visited = 0;      // nodes stepped on, down, up or sideways
+};
+
+inline TreeStats operator-(const TreeStats& a, const TreeStats& b) {
+    TreeStats d;
+    d.comparisons = a.comparisons - b.comparisons;
+    d.rotations = a.rotations - b.rotations;
+    d.recolorings = a.recolorings - b.recolorings;
+    d.allocations = a.allocations - b.allocations;
+    d.visited = a.visited - b.visited;
+    return d;
+}
+
+inline TreeStats& operator+=(TreeStats& a, const TreeStats& b) {
+    a.comparisons += b.comparisons;
+    a.rotations += b.rotations;
+    a.recolorings += b.recolorings;
+    a.allocations += b.allocations;
+    a.visited += b.visited;
+    return a;
+}
+
+// Use inside tree member functions: TREE_STAT(rotations);
+#ifdef BINARYST_STATS
+#define TREE_STAT(field) (++stats.field)
+#else
+#define TREE_STAT(field) ((void)0)
+#endif
+
+#endif // TREESTATS_H
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "TreeWorker.h"
+
+TreeWorker::TreeWorker(Command onIdle, QObject* parent)
+    : QThread(parent)
+    , m_onIdle(std::move(onIdle))
+{
+}
+
+TreeWorker::~TreeWorker()
+{
+    if (isRunning()) stop();
+}
+
+void TreeWorker::post(Command command)
+{
+    m_queue.push(std::move(command));
+    m_pending.release();
+}
+
+void TreeWorker::stop()
+{
+    // An empty command is the end marker
+    post(Command());
+    wait();
+}
+
+void TreeWorker::run()
+{
+    for (;;) {
+        m_pending.acquire();
+        Command command;
+        // The semaphore is released after the push, but the push may not
+        // be linked in yet
+        while (!m_queue.pop(command))
+            yieldCurrentThread();
+
+        if (!command) {
+            m_onIdle();
+            return;
+        }
+        command();
+        if (m_pending.available() == 0)
+            m_onIdle();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef TREEWORKER_H
+#define TREEWORKER_H
+
+#include <QThread>
+#include <QSemaphore>
+#include <functional>
+#include "CommandQueue.h"
+
+// Thread that runs posted commands one at a time, in posting order.
+// Posting never blocks: commands go through a lock-free queue, and the
+// semaphore only counts them so the thread can sleep while there is nothing
+// to do. Each time the queue runs dry, onIdle is called on the worker
+// thread; that is where the owner hands its results back.
+class TreeWorker : public QThread
+{
+public:
+    using Command = std::function<void()>;
+
+    explicit TreeWorker(Command onIdle, QObject* parent = nullptr);
+    ~TreeWorker() override;
+
+    void post(Command command);
+
+    // Runs everything already posted, then ends the thread
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    CommandQueue<Command> m_queue;
+    QSemaphore m_pending;
+    Command m_onIdle;
+};
+
+#endif // TREEWORKER_H
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "WorkStealingPool.h"
+
+// Which pool the current thread works for, and its index there
+static thread_local const WorkStealingPool* currentPool = nullptr;
+static thread_local int currentSlot = -1;
+
+WorkStealingPool::WorkStealingPool(int threads) : running(0), stopping(false) {
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    for (int i = 0; i < threads; ++i) queues.emplace_back(new Worker);
+    for (int i = 0; i < threads; ++i) workers.emplace_back(&WorkStealingPool::loop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : workers) t.join();
+}
+
+WorkStealingPool& WorkStealingPool::shared() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+int WorkStealingPool::slot() const {
+    return currentPool == this ? currentSlot : -1;
+}
+
+void WorkStealingPool::run(const std::function<void()>& f) {
+    if (slot() >= 0) {
+        f();
+        return;
+    }
+    Task root{ &f, { false }, true };
+    {
+        std::lock_guard<std::mutex> guard(queues[0]->lock);
+        queues[0]->tasks.push_back(&root);
+    }
+    std::unique_lock<std::mutex> lock(sleepLock);
+    ++running;
+    wake.notify_all();
+    finished.wait(lock, [&] { return root.done.load(std::memory_order_acquire); });
+    --running;
+}
+
+void WorkStealingPool::invoke(const std::function<void()>& a, const std::function<void()>& b) {
+    int self = slot();
+    Task forked{ &b, { false }, false };
+    {
+        std::lock_guard<std::mutex> guard(queues[self]->lock);
+        queues[self]->tasks.push_back(&forked);
+    }
+    a();
+
+    // Nobody stole b if it is still at the back
+    {
+        std::unique_lock<std::mutex> guard(queues[self]->lock);
+        std::deque<Task*>& own = queues[self]->tasks;
+        if (!own.empty() && own.back() == &forked) {
+            own.pop_back();
+            guard.unlock();
+            b();
+            return;
+        }
+    }
+    while (!forked.done.load(std::memory_order_acquire)) {
+        if (!runOne(self)) std::this_thread::yield();
+    }
+}
+
+void WorkStealingPool::loop(int self) {
+    currentPool = this;
+    currentSlot = self;
+    for (;;) {
+        if (runOne(self)) continue;
+        std::unique_lock<std::mutex> lock(sleepLock);
+        if (stopping) return;
+        if (running == 0) {
+            wake.wait(lock, [&] { return stopping || running > 0; });
+        }
+        else {
+            lock.unlock();
+            std::this_thread::yield();
+        }
+    }
+}
+
+WorkStealingPool::Task* WorkStealingPool::pop(int self) {
+    std::lock_guard<std::mutex> guard(queues[self]->lock);
+    std::deque<Task*>& own = queues[self]->tasks;
+    if (own.empty()) return nullptr;
+    Task* t = own.back();
+    own.pop_back();
+    return t;
+}
+
+// Tries the other workers in turn, starting after self
+WorkStealingPool::Task* WorkStealingPool::steal(int self) {
+    int n = (int)queues.size();
+    for (int i = 1; i <= n; ++i) {
+        Worker& victim = *queues[(self + i) % n];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty()) continue;
+        Task* t = victim.tasks.front();
+        victim.tasks.pop_front();
+        return t;
+    }
+    return nullptr;
+}
+
+bool WorkStealingPool::runOne(int self) {
+    Task* t = pop(self);
+    if (!t) t = steal(self);
+    if (!t) return false;
+    execute(t);
+    return true;
+}
+
+void WorkStealingPool::execute(Task* t) {
+    (*t->fn)();
+    // The waiter may return and free t as soon as done is set
+    if (!t->external) {
+        t->done.store(true, std::memory_order_release);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(sleepLock);
+    t->done.store(true, std::memory_order_release);
+    finished.notify_all();
+}
\ No newline at end of file
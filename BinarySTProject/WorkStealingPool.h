@@ -0,0 +1,68 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join thread pool for divide-and-conquer tree algorithms.
+//
+// Every worker keeps its own deque of forked tasks: it pushes and pops at
+// the back, so it works depth-first on what it forked last, while idle
+// workers steal from the front, where the oldest and biggest tasks are. A
+// worker waiting for a stolen task runs other tasks instead of blocking.
+class WorkStealingPool {
+public:
+    // 0 threads means one per hardware thread
+    explicit WorkStealingPool(int threads = 0);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Process-wide pool used by the trees' set operations
+    static WorkStealingPool& shared();
+
+    int size() const { return (int)workers.size(); }
+
+    // Worker index of the calling thread, -1 outside this pool
+    int slot() const;
+
+    // Runs f on a worker and returns once it and everything it forked are
+    // done. Calls from inside a task just run f.
+    void run(const std::function<void()>& f);
+
+    // Runs a and b, in parallel when another worker is free to steal b.
+    // Only valid inside a task.
+    void invoke(const std::function<void()>& a, const std::function<void()>& b);
+
+private:
+    struct Task {
+        const std::function<void()>* fn;
+        std::atomic<bool> done;
+        bool external;      // from run(): the caller sleeps on finished
+    };
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepLock;
+    std::condition_variable wake, finished;
+    int running;        // run() calls in progress, under sleepLock
+    bool stopping;
+
+    void loop(int self);
+    Task* pop(int self);
+    Task* steal(int self);
+    bool runOne(int self);
+    void execute(Task* t);
+};
+
+#endif // WORKSTEALINGPOOL_H
\ No newline at end of file
@@ -1,18 +1,25 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QQmlEngine>
 #include <QUrl>
 #include <QCoreApplication>
 #include "TreeManager.h"
+#include "TreeRenderer.h"
 
 int main(int argc, char* argv[])
 {
     QGuiApplication app(argc, argv);
 
+    qmlRegisterType<TreeRenderer>("BinarySTApp.Render", 1, 0, "TreeRenderer");
+
     QQmlApplicationEngine engine;
 
     // Create TreeManager instance
     TreeManager treeManager;
+    // Keep tree work off the GUI thread
+    if (app.arguments().contains(QStringLiteral("--threaded")))
+        treeManager.setThreaded(true);
 
     // Expose TreeManager to QML
     engine.rootContext()->setContextProperty("treeManager", &treeManager);
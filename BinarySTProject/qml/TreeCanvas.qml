@@ -1,8 +1,12 @@
 import QtQuick
+import BinarySTApp.Render
 
 Rectangle {
     id: canvasContainer
     property bool autoFit: true
+    // Item whose bounds are the visible window (the Flickable); only that part
+    // of the tree is turned into geometry
+    property Item viewportItem: null
     radius: 15
     color: "#121427"
     border.color: "#2daee6"
@@ -15,12 +19,11 @@ Rectangle {
     // Allow smooth animated scaling when auto-fit or user zooms
     Behavior on scale { NumberAnimation { duration: 300; easing.type: Easing.OutQuad } }
 
-    Canvas {
+    Item {
         id: canvas
         anchors.fill: parent
         anchors.margins: 20
 
-        property var treeData: []
         property var pendingInsertKeys: []
 
         function scheduleInsertAnimation(key) {
@@ -29,170 +32,35 @@ Rectangle {
             repaintTimer.restart()
         }
 
-        onPaint: {
-            var ctx = getContext("2d")
-            ctx.reset()
+        // Nodes and edges are drawn by the scene graph renderer, so a refresh
+        // only sizes the container and starts pending insert animations
+        function refresh() {
+            var flick = canvasContainer.viewportItem || canvasContainer.parent
 
-            // Get tree structure from TreeManager
-            treeData = treeManager.getTreeStructure()
-
-            if (treeData.length === 0) {
+            if (renderer.nodeCount === 0) {
                 // ensure container has minimum size even when empty
                 canvasContainer.width = Math.max(canvasContainer.width || 800, 800)
                 canvasContainer.height = Math.max(canvasContainer.height || 400, 400)
-
-                // Draw empty tree message on visible area
-                ctx.fillStyle = "#9aa3b2"
-                ctx.font = "20px 'Segoe UI'"
-                ctx.textAlign = "center"
-                ctx.fillText("Tree is empty. Insert some nodes!", canvasContainer.width/2 - (translateX||0), canvasContainer.height/2 - (translateY||0))
                 return
             }
 
-            // Build inorder index map to give stable left-to-right placement
-            var inorder = treeManager.getInorderTraversal()
-            var indexMap = {}
-            for (var i = 0; i < inorder.length; ++i) { indexMap[inorder[i]] = i }
-
-            // Layout constants (adaptive)
-            var PADDING = 40
-            var minNodeSpacing = 60
-            var maxNodeSpacing = 160
-            var LEVEL_V_SPACING = 120 // vertical spacing per level
-
-            // determine horizontal spacing based on available width and number of nodes
-            var numNodes = Math.max(1, inorder.length)
-            // prefer available parent width (the Flickable viewport) if possible
-            var flick = canvasContainer.parent
-            var viewportW = (flick && flick.width) ? flick.width : 1000
-            var availableW = Math.max(800, viewportW - 40)
-            var NODE_H_SPACING = Math.floor(Math.min(maxNodeSpacing, Math.max(minNodeSpacing, availableW / Math.max(1, numNodes - 1))))
-
-            // collision avoidance: expand spacing until adjacent nodes don't overlap
-            var NODE_RADIUS = 30
-            var MIN_GAP = 10
-            function nodesOverlapWithSpacing(spacing) {
-                for (var ii = 1; ii < inorder.length; ++ii) {
-                    var leftX = PADDING + (ii-1) * spacing
-                    var rightX = PADDING + ii * spacing
-                    if (Math.abs(rightX - leftX) < (2*NODE_RADIUS + MIN_GAP)) return true
-                }
-                return false
-            }
-
-            var attempt = 0
-            while (nodesOverlapWithSpacing(NODE_H_SPACING) && NODE_H_SPACING < maxNodeSpacing && attempt < 40) {
-                NODE_H_SPACING += 8
-                attempt++
-            }
-
-            // Compute positions and bounding box
-            var minX = Number.POSITIVE_INFINITY, maxX = Number.NEGATIVE_INFINITY
-            var minY = Number.POSITIVE_INFINITY, maxY = Number.NEGATIVE_INFINITY
-
-            var positions = {}
-            for (var i = 0; i < treeData.length; ++i) {
-                var n = treeData[i]
-                var key = n.key
-                if (key === undefined || key === null) continue
-                var idx = (key in indexMap) ? indexMap[key] : i
-                var px = PADDING + idx * NODE_H_SPACING
-                var py = PADDING + n.level * LEVEL_V_SPACING
-                positions[key] = { x: px, y: py }
-                if (px < minX) minX = px
-                if (px > maxX) maxX = px
-                if (py < minY) minY = py
-                if (py > maxY) maxY = py
-            }
-
-            // safety fallback
-            if (!isFinite(minX)) { minX = PADDING; maxX = PADDING + NODE_H_SPACING }
-            if (!isFinite(minY)) { minY = PADDING; maxY = PADDING + LEVEL_V_SPACING }
-
-            // Expand canvasContainer to fit content with padding
-            var requiredW = (maxX - minX) + (2 * PADDING)
-            var requiredH = (maxY - minY) + (2 * PADDING)
+            // Expand canvasContainer to fit content; the renderer's implicit
+            // size already includes its padding
             var minW = 800
             var minH = 400
             // apply sizes on the outer container so Flickable sees changes
-            canvasContainer.width = Math.max(minW, requiredW)
-            canvasContainer.height = Math.max(minH, requiredH)
-
-            // Determine translation to center content horizontally and keep some top margin
-            var translateX = Math.round((canvasContainer.width - (maxX - minX)) / 2 - minX)
-            var translateY = Math.round(80 - minY) // root placed 80px from top
-
-            ctx.translate(translateX, translateY)
-
-            // Draw connections using parent pointers (thicker navy lines)
-            ctx.strokeStyle = "#003366"
-            ctx.lineWidth = 3
-            for (var k = 0; k < treeData.length; ++k) {
-                var cn = treeData[k]
-                var parentKey = cn.parent
-                if (parentKey !== undefined && parentKey !== -1) {
-                    var parentPos = positions[parentKey]
-                    var childPos = positions[cn.key]
-                    if (parentPos && childPos) {
-                        ctx.beginPath()
-                        ctx.moveTo(parentPos.x, parentPos.y)
-                        ctx.lineTo(childPos.x, childPos.y)
-                        ctx.stroke()
-                    }
-                }
-            }
+            canvasContainer.width = Math.max(minW, renderer.implicitWidth)
+            canvasContainer.height = Math.max(minH, renderer.implicitHeight)
 
-            // Draw nodes with 3px white border
-            for (var i = 0; i < treeData.length; ++i) {
-                var currentNode = treeData[i]
-                var key = currentNode.key
-                if (key === undefined || key === null) continue
-                var pos = positions[key]
-                if (!pos) continue
-                var x = pos.x
-                var y = pos.y
-
-                // Node radial gradient
-                var gradient = ctx.createRadialGradient(x, y, 0, x, y, 30)
-                if (currentNode.color === "red") {
-                    gradient.addColorStop(0, "#ff8a80")
-                    gradient.addColorStop(1, "#ef4444")
-                } else if (currentNode.color === "black") {
-                    gradient.addColorStop(0, "#b0b0b0")
-                    gradient.addColorStop(1, "#2d3436")
-                } else {
-                    gradient.addColorStop(0, "#88aaff")
-                    gradient.addColorStop(1, "#0984E3")
-                }
-
-                ctx.fillStyle = gradient
-                ctx.beginPath()
-                ctx.arc(x, y, 30, 0, Math.PI * 2)
-                ctx.fill()
-
-                // Draw node border thick white
-                ctx.strokeStyle = "#ffffff"
-                ctx.lineWidth = 3
-                ctx.stroke()
-
-                // Draw node value - ensure it is a number
-                var display = (typeof key === 'number') ? key.toString() : String(key)
-                ctx.fillStyle = "#ffffff"
-                ctx.font = "bold 16px 'Segoe UI'"
-                ctx.textAlign = "center"
-                ctx.textBaseline = "middle"
-                ctx.fillText(display, x, y)
-            }
-
-            // Handle pending insert animations now that positions & translation are known
+            // Handle pending insert animations now that positions are known
             if (pendingInsertKeys && pendingInsertKeys.length > 0) {
                 for (var pi = 0; pi < pendingInsertKeys.length; ++pi) {
                     var ik = pendingInsertKeys[pi]
-                    var ppos = positions[ik]
-                    if (!ppos) continue
-                    // translate positions into container coordinates (same transform used for drawing)
-                    var animX = ppos.x + translateX
-                    var animY = ppos.y + translateY
+                    var ppos = renderer.nodePosition(ik)
+                    if (ppos === undefined) continue
+                    // translate positions into canvas coordinates
+                    var animX = renderer.x + ppos.x
+                    var animY = renderer.y + ppos.y
                     // give each inserting node a unique random X start offset so fall animation looks natural
                     var startX = animX + (Math.random() * 240 - 120)
                     var startY = -60 - Math.random() * 120
@@ -215,16 +83,62 @@ Rectangle {
                     canvasContainer.scale = targetScale
                 }
             }
+        }
 
-            // Restore any transforms for safety
-            ctx.resetTransform()
+        // Visible window in renderer coordinates, following scrolling and zoom
+        function updateViewport() {
+            var v = canvasContainer.viewportItem
+            if (!v) return
+            renderer.viewport = renderer.mapFromItem(v, 0, 0, v.width, v.height)
         }
 
+        Connections {
+            target: canvasContainer.viewportItem
+            ignoreUnknownSignals: true
+            function onContentXChanged() { canvas.updateViewport() }
+            function onContentYChanged() { canvas.updateViewport() }
+            function onWidthChanged() { canvas.updateViewport() }
+            function onHeightChanged() { canvas.updateViewport() }
+        }
+
+        Connections {
+            target: canvasContainer
+            function onScaleChanged() { canvas.updateViewport() }
+            function onWidthChanged() { canvas.updateViewport() }
+            function onHeightChanged() { canvas.updateViewport() }
+        }
+
+        TreeRenderer {
+            id: renderer
+            // below half size, small subtrees are drawn collapsed
+            zoom: canvasContainer.scale
+            onXChanged: canvas.updateViewport()
+            onYChanged: canvas.updateViewport()
+            manager: treeManager
+            width: implicitWidth
+            height: implicitHeight
+            // center horizontally; the root sits 40px below the renderer's
+            // top edge, so this places it 80px from the top
+            anchors.horizontalCenter: parent.horizontalCenter
+            y: 40
+        }
+
+        Text {
+            anchors.centerIn: parent
+            visible: renderer.nodeCount === 0
+            text: "Tree is empty. Insert some nodes!"
+            color: "#9aa3b2"
+            font.pixelSize: 20
+            font.family: "Segoe UI"
+        }
+
+        Component.onCompleted: repaintTimer.restart()
+
         Timer {
             id: repaintTimer
             interval: 50
             repeat: false
-            onTriggered: canvas.requestPaint()
+            onTriggered: canvas.refresh()
         }
 
         // Model for animated falling nodes
@@ -321,15 +235,8 @@ Rectangle {
                 repaintTimer.restart()
             }
 
-            function onNodeDeleted(key) {
-                repaintTimer.restart()
-            }
-
-            function onTreeCleared() {
-                repaintTimer.restart()
-            }
-
-            function onTreeUpdated() {
+            // the renderer applies the diff itself; only the sizing is redone here
+            function onTreeChanged(changes) {
                 repaintTimer.restart()
             }
         }
@@ -337,7 +244,7 @@ Rectangle {
 
     // expose zoomToFit on the root component so parent QML can call canvas.zoomToFit()
     function zoomToFit(viewW, viewH) {
-        var flick = canvasContainer.parent
+        var flick = canvasContainer.viewportItem || canvasContainer.parent
         var flickW = (viewW && viewW > 0) ? viewW : ((flick && flick.width) ? flick.width : canvasContainer.width)
         var flickH = (viewH && viewH > 0) ? viewH : ((flick && flick.height) ? flick.height : canvasContainer.height)
         if (flickW > 0 && flickH > 0) {
@@ -188,15 +188,9 @@ Rectangle {
                                         if (insertField.text !== "") {
                                             var value = parseInt(insertField.text)
                                             if (!isNaN(value)) {
-                                                var alreadyExists = treeManager.searchNode(value)
-                                                if (alreadyExists) {
-                                                    insertError.text = "Value already exists!"
-                                                    insertError.visible = true
-                                                    insertErrorTimer.start()
-                                                } else {
-                                                    treeManager.insertNode(value)
-                                                    insertField.text = ""
-                                                }
+                                                // single tree walk: duplicate check and insert together;
+                                                // the outcome arrives as insertFinished
+                                                treeManager.tryInsert(value)
                                             }
                                         }
                                     }
@@ -217,6 +211,19 @@ Rectangle {
                                     interval: 2000
                                     onTriggered: insertError.visible = false
                                 }
+
+                                Connections {
+                                    target: treeManager
+                                    function onInsertFinished(key, inserted, depth) {
+                                        if (!inserted) {
+                                            insertError.text = "Value already exists!"
+                                            insertError.visible = true
+                                            insertErrorTimer.start()
+                                        } else if (parseInt(insertField.text) === key) {
+                                            insertField.text = ""
+                                        }
+                                    }
+                                }
                             }
                         }
 
@@ -280,8 +287,16 @@ Rectangle {
                                         var oldVal = parseInt(updateOldField.text)
                                         var newVal = parseInt(updateNewField.text)
                                         if (isNaN(oldVal) || isNaN(newVal)) return
-                                        var ok = treeManager.updateNode(oldVal, 1, newVal, "any")
-                                        if (ok) {
+                                        treeManager.updateNode(oldVal, 1, newVal, "any")
+                                    }
+                                }
+
+                                // Fields are only cleared if they still hold what was submitted
+                                Connections {
+                                    target: treeManager
+                                    function onUpdateFinished(oldValue, newValue, updated) {
+                                        if (updated && parseInt(updateOldField.text) === oldValue
+                                                && parseInt(updateNewField.text) === newValue) {
                                             updateOldField.text = ""
                                             updateNewField.text = ""
                                         }
@@ -491,6 +506,149 @@ Rectangle {
                             }
                         }
 
+                        // Undo / redo through the persistent versions (AVL and RB)
+                        RowLayout {
+                            Layout.fillWidth: true
+                            spacing: 8
+                            visible: treeManager.versionCount > 0
+
+                            OperationButton {
+                                Layout.fillWidth: true
+                                Layout.preferredHeight: 44
+                                text: "Undo"
+                                enabled: treeManager.canUndo
+                                opacity: enabled ? 1.0 : 0.4
+                                gradColor1: "#2daee6"
+                                gradColor2: "#1b8bbf"
+                                textColor: "#FFFFFF"
+                                hoverColor: "#4cc0ee"
+                                onClicked: treeManager.undo()
+                            }
+
+                            OperationButton {
+                                Layout.fillWidth: true
+                                Layout.preferredHeight: 44
+                                text: "Redo"
+                                enabled: treeManager.canRedo
+                                opacity: enabled ? 1.0 : 0.4
+                                gradColor1: "#2daee6"
+                                gradColor2: "#1b8bbf"
+                                textColor: "#FFFFFF"
+                                hoverColor: "#4cc0ee"
+                                onClicked: treeManager.redo()
+                            }
+                        }
+
+                        Text {
+                            visible: treeManager.versionCount > 0
+                            text: "Version " + (treeManager.version + 1) + " of " + treeManager.versionCount
+                            font.family: "Roboto"
+                            font.pixelSize: 12
+                            color: "#b0b3c6"
+                            Layout.alignment: Qt.AlignHCenter
+                        }
+
+                        // Statistics of the last operation and of the tree's shape
+                        GroupBox {
+                            Layout.fillWidth: true
+                            background: Rectangle {
+                                color: "#1a1d35"
+                                radius: 6
+                                border.color: "#2daee6"
+                                border.width: 1
+                            }
+
+                            ColumnLayout {
+                                anchors.fill: parent
+                                spacing: 8
+
+                                Text {
+                                    text: treeManager.statsEnabled ? "Last Operation" : "Last Operation (counters disabled)"
+                                    font.family: "Roboto"
+                                    font.pixelSize: 14
+                                    font.bold: true
+                                    color: "#FFFFFF"
+                                }
+
+                                ColumnLayout {
+                                    Layout.fillWidth: true
+                                    spacing: 4
+
+                                    Repeater {
+                                        model: [
+                                            { label: "Comparisons", value: treeManager.comparisons },
+                                            { label: "Rotations", value: treeManager.rotations },
+                                            { label: "Recolorings", value: treeManager.recolorings },
+                                            { label: "Allocations", value: treeManager.allocations },
+                                            { label: "Nodes visited", value: treeManager.nodesVisited }
+                                        ]
+
+                                        delegate: RowLayout {
+                                            Layout.fillWidth: true
+                                            opacity: treeManager.statsEnabled ? 1.0 : 0.5
+
+                                            Text {
+                                                text: modelData.label
+                                                Layout.fillWidth: true
+                                                font.family: "Roboto"
+                                                font.pixelSize: 12
+                                                color: "#b0b3c6"
+                                            }
+                                            Text {
+                                                text: modelData.value
+                                                font.family: "Roboto"
+                                                font.pixelSize: 12
+                                                font.bold: true
+                                                color: "#2daee6"
+                                            }
+                                        }
+                                    }
+                                }
+
+                                Rectangle { Layout.fillWidth: true; height: 1; color: "#3a3d55" }
+
+                                Text {
+                                    text: "Tree"
+                                    font.family: "Roboto"
+                                    font.pixelSize: 14
+                                    font.bold: true
+                                    color: "#FFFFFF"
+                                }
+
+                                ColumnLayout {
+                                    Layout.fillWidth: true
+                                    spacing: 4
+
+                                    Repeater {
+                                        model: [
+                                            { label: "Size", value: treeManager.treeSize },
+                                            { label: "Height", value: treeManager.treeHeight },
+                                            { label: "Average depth", value: treeManager.averageDepth.toFixed(2) }
+                                        ]
+
+                                        delegate: RowLayout {
+                                            Layout.fillWidth: true
+
+                                            Text {
+                                                text: modelData.label
+                                                Layout.fillWidth: true
+                                                font.family: "Roboto"
+                                                font.pixelSize: 12
+                                                color: "#b0b3c6"
+                                            }
+                                            Text {
+                                                text: modelData.value
+                                                font.family: "Roboto"
+                                                font.pixelSize: 12
+                                                font.bold: true
+                                                color: "#2daee6"
+                                            }
+                                        }
+                                    }
+                                }
+                            }
+                        }
+
                         OperationButton { 
                             Layout.fillWidth: true
                             Layout.preferredHeight: 50
@@ -637,6 +795,7 @@ Rectangle {
                     // Instantiate TreeCanvas without forcing width/height so it can compute its bounding box
                     TreeCanvas { 
                         id: canvas
+                        viewportItem: flickableCanvas
                         // scale around center so zoom-to-fit keeps content centered
                         transformOrigin: Item.Center
                         // let TreeCanvas control its own width/height and scaling
@@ -657,10 +816,15 @@ Rectangle {
                     // Ensure view recenters and fits after tree updates
                     Connections {
                         target: treeManager
-                        function onNodeInserted(key) { Qt.callLater(fitAndCenter) }
-                        function onNodeDeleted(key) { Qt.callLater(fitAndCenter) }
-                        function onTreeCleared() { Qt.callLater(fitAndCenter) }
-                        function onTreeUpdated() { Qt.callLater(fitAndCenter) }
+                        function onTreeChanged(changes) {
+                            // recolors (3) and rekeys (4) keep the tree's extent
+                            for (var i = 0; i < changes.length; i += 3) {
+                                if (changes[i] !== 3 && changes[i] !== 4) {
+                                    Qt.callLater(fitAndCenter)
+                                    return
+                                }
+                            }
+                        }
                     }
                 }
 